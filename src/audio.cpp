@@ -0,0 +1,173 @@
+#include "audio.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Amplitude of the square waves, a quarter of full scale
+const int16_t AUDIO_VOLUME = 8192;
+
+AudioFrame audio_frame(const Chip8 &chip8, uint64_t frame) {
+    AudioFrame audio{};
+    audio.frame = frame;
+    audio.on = chip8.sound_on();
+    audio.pitch = chip8.sound_pitch();
+    memcpy(audio.pattern, chip8.sound_pattern(), AUDIO_PATTERN_SIZE);
+    return audio;
+}
+
+bool AudioChannel::pop(AudioFrame &frame, size_t lag) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    size_t end = head.load(std::memory_order_acquire);
+    if (position == end) {
+        return false;
+    }
+    if (end - position > lag + 1) {
+        position = end - 1;
+    }
+    frame = ring[position & (AUDIO_RING_SIZE - 1)];
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+AudioSynth::AudioSynth(unsigned int sample_rate) : sample_rate(sample_rate) {
+    set(AudioFrame{});
+}
+
+void AudioSynth::set(const AudioFrame &frame) {
+    bool pattern = false;
+    for (uint8_t byte : frame.pattern) {
+        pattern |= byte != 0;
+    }
+
+    // only a change of tone needs the step worked out again
+    if (pattern == beeper || frame.pitch != current.pitch || step == 0) {
+        double frequency = BEEPER_FREQUENCY;
+        if (pattern) {
+            double bits_per_second = 4000.0 * std::pow(2.0, (frame.pitch - 64) / 48.0);
+            frequency = bits_per_second / (AUDIO_PATTERN_SIZE * 8);
+        }
+        step = static_cast<uint32_t>(frequency / sample_rate * 4294967296.0);
+    }
+    beeper = !pattern;
+    current = frame;
+}
+
+void AudioSynth::render(int16_t *samples, size_t count) {
+    if (!current.on) {
+        std::fill(samples, samples + count, 0);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bool high;
+        if (beeper) {
+            high = phase < 0x80000000u;
+        } else {
+            // the top 7 bits of the phase pick one of the pattern's 128 bits
+            unsigned int bit = phase >> 25u;
+            high = (current.pattern[bit / 8] >> (7 - bit % 8)) & 1u;
+        }
+        samples[i] = high ? AUDIO_VOLUME : -AUDIO_VOLUME;
+        phase += step;
+    }
+}
+
+AudioPlayer::AudioPlayer(AudioChannel &channel, unsigned int sample_rate)
+        : channel(channel), synth(sample_rate), frame_samples(sample_rate / FRAMES_PER_SECOND) {
+}
+
+void AudioPlayer::fill(int16_t *samples, size_t count) {
+    while (count > 0) {
+        if (left == 0) {
+            AudioFrame frame;
+            bool got = channel.pop(frame);
+            // frames whose time has already been played are dropped. Any
+            // other number, e.g. going back after a rewind or skipping
+            // frames the full ring didn't take, is where playing carries on.
+            while (got && frame.frame < next && next - frame.frame <= missed) {
+                got = channel.pop(frame);
+            }
+
+            if (got) {
+                synth.set(frame);
+                next = frame.frame + 1;
+                missed = 0;
+            } else {
+                if (missed > 0) {
+                    // the emulator has stopped, don't hold a note forever
+                    synth.set(AudioFrame{});
+                }
+                // otherwise it's probably just late, carry on with the
+                // last frame once
+                missed++;
+                next++;
+            }
+            left = frame_samples;
+        }
+
+        size_t n = count < left ? count : left;
+        synth.render(samples, n);
+        samples += n;
+        count -= n;
+        left -= n;
+    }
+}
+
+// RIFF header of a 16-bit mono PCM WAV file, sizes filled in on close
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data[4];
+    uint32_t data_size;
+};
+
+static_assert(sizeof(WavHeader) == 44, "WAV headers are 44 bytes");
+
+static WavHeader wav_header(unsigned int sample_rate, uint32_t data_size) {
+    return {{'R', 'I', 'F', 'F'}, 36 + data_size, {'W', 'A', 'V', 'E'}, {'f', 'm', 't', ' '}, 16, 1, 1,
+            sample_rate, sample_rate * 2, 2, 16, {'d', 'a', 't', 'a'}, data_size};
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+bool WavWriter::open(char const *filename, unsigned int sample_rate) {
+    file = std::fopen(filename, "wb");
+    if (file == nullptr) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+    this->sample_rate = sample_rate;
+    data_size = 0;
+    WavHeader header = wav_header(sample_rate, 0);
+    return std::fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+void WavWriter::write(const int16_t *samples, size_t count) {
+    if (file != nullptr) {
+        data_size += std::fwrite(samples, sizeof(int16_t), count, file) * sizeof(int16_t);
+    }
+}
+
+bool WavWriter::close() {
+    if (file == nullptr) {
+        return true;
+    }
+
+    WavHeader header = wav_header(sample_rate, data_size);
+    bool written = std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    written = std::fclose(file) == 0 && written;
+    file = nullptr;
+    return written;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "chip8.h"
+
+// Samples per second, a whole number of samples per 60 Hz frame
+const unsigned int AUDIO_SAMPLE_RATE = 48000;
+const unsigned int AUDIO_FRAME_SAMPLES = AUDIO_SAMPLE_RATE / FRAMES_PER_SECOND;
+
+// Samples the device asks for at a time, 5.3 ms, well under the 10 ms that
+// starts to be noticeable
+const unsigned int AUDIO_BUFFER_SAMPLES = 256;
+
+// Frames buffered between the emulator and the audio thread, a power of two
+const size_t AUDIO_RING_SIZE = 16;
+
+// Frames the audio thread lets itself fall behind before it skips ahead
+const size_t AUDIO_MAX_LAG = 2;
+
+// The tone played when no XO-CHIP pattern has been loaded
+const unsigned int BEEPER_FREQUENCY = 440;
+
+// What the sound does for one frame
+struct AudioFrame {
+    uint64_t frame; // number of the frame in the run, which says when it's due
+    bool on;
+    uint8_t pitch;
+    uint8_t pattern[AUDIO_PATTERN_SIZE]; // all zero until F002 loads one
+};
+
+// The sound a machine makes during the frame after the one it just ran
+AudioFrame audio_frame(const Chip8 &chip8, uint64_t frame);
+
+// Frames from the emulator's thread to the audio thread, in a ring buffer
+// that only the emulator writes to and the audio callback reads from. The
+// emulator never waits: when the ring is full, i.e. no audio is playing,
+// the frame is dropped.
+class AudioChannel {
+public:
+    // Emulator side
+    bool push(const AudioFrame &frame) {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == AUDIO_RING_SIZE) {
+            return false;
+        }
+        ring[position & (AUDIO_RING_SIZE - 1)] = frame;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Audio side: take the oldest frame, or skip to the newest one when
+    // more than `lag` are waiting. False if there are none.
+    bool pop(AudioFrame &frame, size_t lag = AUDIO_MAX_LAG);
+
+private:
+    AudioFrame ring[AUDIO_RING_SIZE]{};
+    alignas(64) std::atomic<size_t> head{0}; // next frame to fill, owned by the emulator
+    alignas(64) std::atomic<size_t> tail{0}; // next frame to play, owned by the audio thread
+};
+
+// Turns frames into 16-bit mono samples. The plain beeper is a square
+// wave; an XO-CHIP pattern is played one bit per sample period at
+// 4000 * 2^((pitch - 64) / 48) bits per second, looping. The waveform's
+// phase carries over from frame to frame, so there are no clicks.
+class AudioSynth {
+public:
+    explicit AudioSynth(unsigned int sample_rate = AUDIO_SAMPLE_RATE);
+
+    // The sound to make from now on
+    void set(const AudioFrame &frame);
+
+    void render(int16_t *samples, size_t count);
+
+private:
+    unsigned int sample_rate;
+    AudioFrame current{};
+    bool beeper = true;
+    uint32_t phase{}; // position in the waveform, a whole turn is 2^32
+    uint32_t step{};  // phase advance per sample
+};
+
+// The audio thread's end of a channel: each frame is played for 1/60 s,
+// in order. If the next frame isn't there in time, the last one is held for
+// a frame, and when the late frame turns up it's dropped, so the sound
+// doesn't stay a frame behind. If the emulator stops sending frames, e.g.
+// while it's rewinding, whatever was playing stops after that one frame.
+class AudioPlayer {
+public:
+    explicit AudioPlayer(AudioChannel &channel, unsigned int sample_rate = AUDIO_SAMPLE_RATE);
+
+    // Called by the audio device for the next `count` samples
+    void fill(int16_t *samples, size_t count);
+
+private:
+    AudioChannel &channel;
+    AudioSynth synth;
+    size_t frame_samples;
+    size_t left{};     // samples left of the current frame
+    uint64_t next{};   // number of the frame due now
+    uint64_t missed{}; // frames in a row that weren't there in time
+};
+
+// A 16-bit mono WAV file, for recording the sound of headless runs
+class WavWriter {
+public:
+    ~WavWriter();
+
+    bool open(char const *filename, unsigned int sample_rate = AUDIO_SAMPLE_RATE);
+    void write(const int16_t *samples, size_t count);
+
+    // Fill in the header's sizes and close the file
+    bool close();
+
+private:
+    std::FILE *file{};
+    unsigned int sample_rate{};
+    uint32_t data_size{};
+};
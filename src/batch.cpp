@@ -0,0 +1,156 @@
+#include "batch.h"
+#include "halt.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace {
+
+// A worker's share of the jobs. The owner takes jobs from the front and
+// thieves take them from the back, so they rarely touch the same end.
+struct JobQueue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+// Take up to `count` jobs from the front of our own queue
+size_t take(JobQueue &queue, size_t *taken, size_t count) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    size_t n = 0;
+    while (n < count && !queue.jobs.empty()) {
+        taken[n++] = queue.jobs.front();
+        queue.jobs.pop_front();
+    }
+    return n;
+}
+
+// Take up to half of another worker's remaining jobs from the back
+size_t steal(JobQueue &queue, size_t *taken, size_t count) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    size_t half = (queue.jobs.size() + 1) / 2;
+    size_t n = 0;
+    while (n < count && n < half) {
+        taken[n++] = queue.jobs.back();
+        queue.jobs.pop_back();
+    }
+    return n;
+}
+
+// Run a job on a fresh machine, or on one that has loaded the job's ROM
+// before, which only needs a reset
+bool run_job(Chip8 &chip8, bool loaded, Core core, const BatchJob &job, BatchResult &result) {
+    chip8.core = core;
+    chip8.set_quirks(job.quirks);
+    if (loaded) {
+        chip8.reset();
+    } else if (!job.rom || !chip8.load_rom(job.rom->data(), job.rom->size())) {
+        result.loaded = false;
+        return false;
+    }
+    chip8.seed(job.seed);
+
+    // play back the input script at the start of each frame, and once it's
+    // all been played, watch for the machine going round in a cycle
+    HaltDetector halt;
+    size_t next = 0;
+    result.halted_at = 0;
+    result.period = 0;
+    result.skipped = 0;
+    result.crashed_at = 0;
+    for (uint64_t frame = 0; frame < job.frames; frame++) {
+        play_input(job.input, next, frame, chip8.keypad);
+        chip8.run_frame(job.cycles_per_frame);
+        if (chip8.crashed()) {
+            // only this machine stops, the rest of the batch carries on
+            result.crashed_at = frame + 1;
+            result.crash_pc = chip8.next_address();
+            result.crash_opcode = chip8.next_opcode();
+            break;
+        }
+        if (job.stop_when_halted && next == job.input.size() && halt.update(chip8)) {
+            // only the part of a lap left over at the end needs running
+            uint64_t rest = job.frames - frame - 1;
+            uint64_t left = halt.frames_left(rest);
+            for (uint64_t i = 0; i < left; i++) {
+                chip8.run_frame(job.cycles_per_frame);
+            }
+            result.halted_at = frame + 1;
+            result.period = halt.period();
+            result.skipped = rest - left;
+            break;
+        }
+    }
+
+    result.loaded = true;
+    result.hash = chip8.hash();
+    result.display = chip8.display;
+    return true;
+}
+
+}
+
+BatchRunner::BatchRunner(unsigned int threads, Core core) : threads(threads), core(core) {
+    if (this->threads == 0) {
+        this->threads = std::thread::hardware_concurrency();
+    }
+    if (this->threads == 0) {
+        this->threads = 1;
+    }
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob> &jobs) {
+    std::vector<BatchResult> results(jobs.size());
+    if (jobs.empty()) {
+        return results;
+    }
+
+    size_t workers = threads < jobs.size() ? threads : jobs.size();
+    std::vector<JobQueue> queues(workers);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        queues[i * workers / jobs.size()].jobs.push_back(i);
+    }
+
+    auto worker = [&](size_t id) {
+        // every job this worker runs gets a slot in one contiguous block of machines
+        std::unique_ptr<Chip8[]> arena(new Chip8[BATCH_ARENA_SIZE]);
+        const Rom *loaded[BATCH_ARENA_SIZE]{};
+        size_t taken[BATCH_ARENA_SIZE];
+
+        while (true) {
+            size_t count = take(queues[id], taken, BATCH_ARENA_SIZE);
+            for (size_t i = 1; count == 0 && i < workers; i++) {
+                count = steal(queues[(id + i) % workers], taken, BATCH_ARENA_SIZE);
+            }
+            if (count == 0) {
+                // nothing is ever added, so empty queues mean we're done
+                return;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                // a machine that ran the same ROM before is reset, which keeps
+                // everything it translated, others start from a fresh machine
+                const BatchJob &job = jobs[taken[i]];
+                Chip8 *chip8 = &arena[i];
+                bool reuse = job.rom && job.rom.get() == loaded[i];
+                if (!reuse) {
+                    chip8->~Chip8();
+                    new(chip8) Chip8();
+                }
+                bool ran = run_job(*chip8, reuse, core, job, results[taken[i]]);
+                loaded[i] = ran ? job.rom.get() : nullptr;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t id = 1; id < workers; id++) {
+        pool.emplace_back(worker, id);
+    }
+    worker(0);
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+    return results;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "chip8.h"
+#include "movie.h"
+#include "rom.h"
+
+// Number of machines in each worker's arena, i.e. how many jobs a worker
+// takes from its queue at a time
+const unsigned int BATCH_ARENA_SIZE = 16;
+
+// One machine to run in a batch
+struct BatchJob {
+    std::shared_ptr<const Rom> rom; // shared between jobs, see RomCache
+    uint64_t seed{};
+    std::vector<KeyEvent> input; // sorted by frame
+    uint64_t frames{};           // frames to run
+    unsigned int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    Quirks quirks = Quirks::Legacy;
+    bool stop_when_halted = true; // skip the frames of a cycle the machine is stuck in, see HaltDetector
+};
+
+// The state of a machine at the end of its job
+struct BatchResult {
+    bool loaded{};
+    uint64_t hash{};
+    Display display;
+    uint64_t halted_at{}; // frame the machine was found repeating itself, 0 if it never was
+    uint64_t period{};    // frames in the cycle it repeats
+    uint64_t skipped{};   // frames not run because of it
+    uint64_t crashed_at{}; // frame the machine stopped at an unknown opcode in, 0 if it never did
+    uint16_t crash_pc{};   // where, and what the opcode was
+    uint16_t crash_opcode{};
+};
+
+// Runs many independent machines across a pool of worker threads. Jobs are
+// dealt out to the workers in contiguous runs, and a worker that runs out
+// steals from the back of another worker's queue.
+class BatchRunner {
+public:
+    explicit BatchRunner(unsigned int threads = 0, Core core = Core::Table);
+
+    std::vector<BatchResult> run(const std::vector<BatchJob> &jobs);
+
+private:
+    unsigned int threads;
+    Core core;
+};
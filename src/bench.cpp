@@ -0,0 +1,354 @@
+#include "chip8.h"
+#include "movie.h"
+#include "rom.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Seed used for every run, so the final hashes are comparable between builds
+const uint64_t BENCH_SEED = 0;
+
+// Each Dxyn is timed on its own in a loop run for at least this long, far
+// above the resolution of the clock, and as many times again as there are
+// runs. The fastest run counts, and how far the median is from it is the
+// noise.
+const double DRAW_MIN_SECONDS = 0.002;
+const unsigned int DRAW_RUNS = 5;
+
+// Bounds on the iterations of a timed loop, the upper one keeps the
+// instruction count inside an unsigned int
+const unsigned int DRAW_MIN_ITERATIONS = 1024;
+const unsigned int DRAW_MAX_ITERATIONS = 1u << 30u;
+
+// Where the draw timing loop is placed in memory, as far up as a jump reaches
+const uint16_t DRAW_LOOP_ADDRESS = CODE_SIZE - 4;
+
+struct CoreName {
+    Core core;
+    char const *name;
+};
+
+const CoreName cores[] = {
+        {Core::Switch, "switch"},
+        {Core::Table,  "table"},
+        {Core::Block,  "block"},
+        {Core::Jit,    "jit"},
+};
+
+struct Result {
+    std::string rom;
+    char const *core;
+    double seconds;
+    double instructions_per_second;
+    double frames_per_second;
+    double ns_per_draw; // 0 when the ROM has no Dxyn
+    bool draw_noisy;    // ns_per_draw is within the timing noise
+    uint64_t hash;
+};
+
+static void usage(char const *program) {
+    std::cerr << "Usage: " << program << " [options] [ROM or directory...]\n"
+              << "  --cycles <n>    instructions to run per ROM (default 2000000)\n"
+              << "  --ipf <n>       instructions per frame (default " << DEFAULT_CYCLES_PER_FRAME << ")\n"
+              << "  --core <name>   switch, table, block, jit or all (default all)\n"
+              << "  --quirks <name> legacy, vip, chip48, schip or modern (default legacy)\n"
+              << "  --json          print the results as JSON\n"
+              << "  Without ROMs, everything in " << CHIP8_ROM_DIR << " is run\n";
+    std::exit(EXIT_FAILURE);
+}
+
+// The same input for every ROM: each key in turn is held for a few frames,
+// which gets most games past their title screens
+static std::vector<KeyEvent> scripted_input(uint64_t frames) {
+    const uint64_t period = 30;
+    const uint64_t hold = 5;
+    std::vector<KeyEvent> input;
+    for (uint64_t frame = period; frame + hold < frames; frame += period) {
+        uint8_t key = static_cast<uint8_t>((frame / period) % KEY_COUNT);
+        input.push_back({frame, key, true});
+        input.push_back({frame + hold, key, false});
+    }
+    return input;
+}
+
+struct LoopTime {
+    double best;   // seconds per iteration in the fastest run
+    double spread; // and how much slower the median one was
+};
+
+// Time a two instruction loop, opcode then a jump back to it, on a machine
+// in the given state
+static LoopTime time_loop(Core core, Quirks quirks, const Snapshot &state, uint16_t opcode) {
+    Snapshot snapshot = state;
+    snapshot.memory[DRAW_LOOP_ADDRESS] = opcode >> 8u;
+    snapshot.memory[DRAW_LOOP_ADDRESS + 1] = opcode & 0xFFu;
+    snapshot.memory[DRAW_LOOP_ADDRESS + 2] = 0x10u | (DRAW_LOOP_ADDRESS >> 8u);
+    snapshot.memory[DRAW_LOOP_ADDRESS + 3] = DRAW_LOOP_ADDRESS & 0xFFu;
+    snapshot.pc = DRAW_LOOP_ADDRESS;
+
+    Chip8 chip8;
+    chip8.core = core;
+    chip8.set_quirks(quirks);
+    auto seconds = [&](unsigned int iterations) {
+        chip8.restore(snapshot);
+        auto start = std::chrono::steady_clock::now();
+        chip8.run(2 * iterations);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    };
+
+    // double the iterations until a run is long enough to time, which also
+    // warms up the caches and translates the loop
+    unsigned int iterations = DRAW_MIN_ITERATIONS;
+    while (seconds(iterations) < DRAW_MIN_SECONDS && iterations < DRAW_MAX_ITERATIONS) {
+        iterations *= 2;
+    }
+
+    double times[DRAW_RUNS];
+    for (double &time : times) {
+        time = seconds(iterations) / iterations;
+    }
+    std::sort(std::begin(times), std::end(times));
+    return {times[0], times[DRAW_RUNS / 2] - times[0]};
+}
+
+// Average cost of the ROM's own Dxyn instructions, drawn with the sprite
+// pointer and registers the ROM ended up with. The cost of the loop around
+// them is measured with a 6xkk in place of the Dxyn and taken off, and a
+// Dxyn that comes out faster than that counts as free. noisy is set when
+// the result is no bigger than the noise of the timings it came from.
+static double time_draws(Core core, Quirks quirks, const Rom &rom, const Snapshot &state, bool &noisy) {
+    noisy = false;
+    std::vector<uint16_t> draws;
+    for (size_t i = 0; i + 1 < rom.size(); i += 2) {
+        uint16_t opcode = (rom.data()[i] << 8u) | rom.data()[i + 1];
+        if ((opcode & 0xF000u) == 0xD000u) {
+            draws.push_back(opcode);
+        }
+    }
+    std::sort(draws.begin(), draws.end());
+    draws.erase(std::unique(draws.begin(), draws.end()), draws.end());
+
+    // sprite data has to stay inside memory
+    if (draws.empty() || state.index + 16 > DRAW_LOOP_ADDRESS) {
+        return 0;
+    }
+
+    LoopTime baseline = time_loop(core, quirks, state, 0x6000);
+    double total = 0;
+    double noise = 0;
+    for (uint16_t opcode : draws) {
+        LoopTime draw = time_loop(core, quirks, state, opcode);
+        total += std::max(0.0, draw.best - baseline.best);
+        noise += draw.spread + baseline.spread;
+    }
+    noisy = total <= noise;
+    return total / draws.size() * 1e9;
+}
+
+static bool run(const std::string &filename, const CoreName &core, Quirks quirks, uint64_t cycles,
+                unsigned int cycles_per_frame, Result &result) {
+    // every core runs the same cached image of the ROM
+    std::shared_ptr<const Rom> rom = RomCache::load(filename.c_str());
+    if (!rom) {
+        return false;
+    }
+
+    Chip8 chip8;
+    chip8.core = core.core;
+    chip8.set_quirks(quirks);
+    chip8.seed(BENCH_SEED);
+    if (!chip8.load_rom(rom->data(), rom->size())) {
+        return false;
+    }
+
+    uint64_t frames = cycles / cycles_per_frame;
+    std::vector<KeyEvent> input = scripted_input(frames);
+    size_t next = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        play_input(input, next, frame, chip8.keypad);
+        chip8.run_frame(cycles_per_frame);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    Snapshot state;
+    chip8.save(state);
+
+    double seconds = elapsed.count();
+    result.rom = std::filesystem::path(filename).filename().string();
+    result.core = core.name;
+    result.seconds = seconds;
+    result.instructions_per_second = seconds > 0 ? frames * cycles_per_frame / seconds : 0;
+    result.frames_per_second = seconds > 0 ? frames / seconds : 0;
+    result.ns_per_draw = time_draws(core.core, quirks, *rom, state, result.draw_noisy);
+    result.hash = chip8.hash();
+    return true;
+}
+
+static std::string hex(uint64_t value) {
+    char text[19];
+    snprintf(text, sizeof(text), "0x%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+// A string as a JSON string literal, quotes and all
+static std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[7];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static void print_json(const std::vector<Result> &results, uint64_t cycles, unsigned int cycles_per_frame) {
+    std::cout << "{\n  \"cycles\": " << cycles << ",\n  \"ipf\": " << cycles_per_frame
+              << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        std::cout << (i ? ",\n" : "\n")
+                  << "    {\"rom\": " << json_string(result.rom) << ", \"core\": \"" << result.core << "\""
+                  << ", \"seconds\": " << result.seconds
+                  << ", \"instructions_per_second\": " << result.instructions_per_second
+                  << ", \"frames_per_second\": " << result.frames_per_second
+                  << ", \"ns_per_draw\": " << result.ns_per_draw
+                  << ", \"ns_per_draw_noisy\": " << (result.draw_noisy ? "true" : "false")
+                  << ", \"hash\": \"" << hex(result.hash) << "\"}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+static void print_table(const std::vector<Result> &results, size_t core_count) {
+    printf("%-20s %-7s %10s %10s %9s  %-18s %s\n",
+           "ROM", "core", "Minstr/s", "frames/s", "ns/Dxyn", "hash", "speedup");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        const Result &first = results[i - i % core_count];
+        printf("%-20s %-7s %10.2f %10.0f %8.1f%c  %s %6.2fx%s\n",
+               result.rom.c_str(), result.core, result.instructions_per_second / 1e6,
+               result.frames_per_second, result.ns_per_draw, result.draw_noisy ? '?' : ' ',
+               hex(result.hash).c_str(),
+               first.instructions_per_second > 0
+               ? result.instructions_per_second / first.instructions_per_second : 0,
+               result.hash != first.hash ? "  HASH MISMATCH" : "");
+    }
+
+    if (std::any_of(results.begin(), results.end(), [](const Result &result) { return result.draw_noisy; })) {
+        printf("\n? ns/Dxyn is within the timing noise\n");
+    }
+
+    // geometric mean over all ROMs, per core
+    printf("\n");
+    for (size_t core = 0; core < core_count; core++) {
+        double log_sum = 0;
+        size_t count = 0;
+        for (size_t i = core; i < results.size(); i += core_count) {
+            if (results[i].instructions_per_second > 0) {
+                log_sum += std::log(results[i].instructions_per_second);
+                count++;
+            }
+        }
+        printf("%-7s geomean %.2f Minstr/s\n", results[core].core,
+               count ? std::exp(log_sum / count) / 1e6 : 0);
+    }
+}
+
+// Run every ROM on each core and report how fast it went
+int main(int argc, char *argv[]) {
+    uint64_t cycles = 2000000;
+    unsigned int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    std::vector<CoreName> selected(std::begin(cores), std::end(cores));
+    Quirks quirks = Quirks::Legacy;
+    bool json = false;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--cycles" && has_value) {
+            cycles = std::stoull(argv[++i]);
+        } else if (arg == "--ipf" && has_value) {
+            cycles_per_frame = std::stoul(argv[++i]);
+        } else if (arg == "--core" && has_value) {
+            std::string name = argv[++i];
+            if (name != "all") {
+                auto found = std::find_if(std::begin(cores), std::end(cores),
+                                          [&name](const CoreName &core) { return name == core.name; });
+                if (found == std::end(cores)) {
+                    usage(argv[0]);
+                }
+                selected = {*found};
+            }
+        } else if (arg == "--quirks" && has_value) {
+            if (!parse_quirks(argv[++i], quirks)) {
+                usage(argv[0]);
+            }
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg[0] != '-') {
+            roms.push_back(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (cycles_per_frame == 0 || cycles < cycles_per_frame) {
+        usage(argv[0]);
+    }
+    if (roms.empty()) {
+        roms.push_back(CHIP8_ROM_DIR);
+    }
+
+    // expand directories into the ROMs in them, in a stable order
+    std::vector<std::string> files;
+    for (const std::string &path : roms) {
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            std::vector<std::string> found;
+            for (const auto &entry : std::filesystem::directory_iterator(path, error)) {
+                if (entry.is_regular_file()) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(path);
+        }
+    }
+
+    std::vector<Result> results;
+    for (const std::string &file : files) {
+        for (const CoreName &core : selected) {
+            Result result{};
+            if (!run(file, core, quirks, cycles, cycles_per_frame, result)) {
+                std::cerr << "ROM not loaded: " << file << std::endl;
+                return EXIT_FAILURE;
+            }
+            results.push_back(result);
+        }
+    }
+
+    if (json) {
+        print_json(results, cycles, cycles_per_frame);
+    } else {
+        print_table(results, selected.size());
+    }
+    return 0;
+}
@@ -1,15 +1,14 @@
 #include "chip8.h"
+#include "jit.h"
+#include "profiler.h"
+#include "rom.h"
+#include "trace.h"
+#include "snapshot.h"
 #include <iostream>
 #include <chrono>
-#include <fstream>
+#include <cstdio>
 #include <cstring>
-
-// The Chip8’s memory from 0x000 to 0x1FF is reserved
-// so the ROM instructions must start at 0x200.
-const unsigned int START_ADDRESS = 0x200;
-
-// There are 16 different (0-F) 5-byte fonts.
-const unsigned int FONTSET_SIZE = 80;
+#include <vector>
 
 // Each character sprite is 5 bytes, and each bit represents a pixel.
 // Each bit represents a pixel, where 1 is on, and 0 is off.
@@ -40,226 +39,701 @@ uint8_t fontset[FONTSET_SIZE] = {
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// The large characters are 8x10 and drawn at high resolution
+uint8_t bigfont[BIGFONT_SIZE] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
 const uint8_t VF = 0xF;
 
-Chip8::Chip8() : rand_gen(std::chrono::system_clock::now().time_since_epoch().count()) {
-    // the first instruction executed will be at 0x200
+static_assert(HIRES_HEIGHT <= 64, "dirty_rows needs a bit per display row");
+
+Chip8::Chip8() {
+    // the first instruction executed will be at 0x200, memory, the stack,
+    // the keypad and the registers all start out cleared
     pc = START_ADDRESS;
     opcode = 0;
-    index = 0;
-    sp = 0;
 
-    // clear the display
-    for (int i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
-        video[i] = 0;
+    // load fonts into memory
+    memcpy(memory, fontset, FONTSET_SIZE);
+    memcpy(&memory[FONTSET_SIZE], bigfont, BIGFONT_SIZE);
+    memset(stale_pages, 0xFF, sizeof(stale_pages));
+
+    // Chip8 has an instruction which places a random number into a register.
+    // this will initialize the RNG for the instruction, call seed() for runs
+    // that have to be reproducible.
+    rand_gen.seed(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+Chip8::~Chip8() = default;
+
+bool Chip8::load_rom(const char *filename) {
+    // Map the file rather than reading it, so it's only copied once, straight
+    // into memory. Its size has been checked by then.
+    std::shared_ptr<const Rom> rom = Rom::map(filename);
+    return rom && load_rom(rom->data(), rom->size());
+}
+
+// Load a ROM that's already in memory, starting at 0x200
+bool Chip8::load_rom(const uint8_t *data, size_t size) {
+    if (size > MAX_ROM_SIZE) {
+        std::cerr << "ROM is too large (" << size << " bytes)" << std::endl;
+        return false;
     }
 
-    // clear the stack, keypad, and registers
-    for (int i = 0; i < 16; ++i) {
-        stack[i] = 0;
-        registers[i] = 0;
-        keypad[i] = 0;
+    memcpy(&memory[START_ADDRESS], data, size);
+    flush_blocks();
+    memset(stale_pages, 0xFF, sizeof(stale_pages));
+
+    // what reset() goes back to
+    auto loaded = std::make_shared<Snapshot>();
+    save(*loaded);
+    image = loaded;
+    memset(written, 0, sizeof(written));
+    return true;
+}
+
+// Reseed the random number generator used by Cxkk
+void Chip8::seed(uint64_t value) {
+    rand_gen.seed(value);
+}
+
+// Capture the machine's state
+void Chip8::save(Snapshot &snapshot) const {
+    memcpy(snapshot.memory, memory, sizeof(memory));
+    snapshot.display = display;
+    memcpy(snapshot.stack, stack, sizeof(stack));
+    memcpy(snapshot.registers, registers, sizeof(registers));
+    memcpy(snapshot.keypad, keypad, sizeof(keypad));
+    memcpy(snapshot.user_flags, user_flags, sizeof(user_flags));
+    memcpy(snapshot.audio_pattern, audio_pattern, sizeof(audio_pattern));
+    snapshot.index = index;
+    snapshot.pc = pc;
+    snapshot.sp = sp;
+    snapshot.delay_timer = delay_timer;
+    snapshot.sound_timer = sound_timer;
+    snapshot.plane_mask = plane_mask;
+    snapshot.pitch = pitch;
+    snapshot.crashed = crash;
+    snapshot.rand_gen = rand_gen;
+    snapshot.quirks = quirk_profile;
+}
+
+// Put the machine back into a saved state, under the profile it was saved
+// with
+void Chip8::restore(const Snapshot &snapshot) {
+    set_quirks(snapshot.quirks);
+
+    // Only memory that actually differs is copied, so that translated
+    // blocks covering unchanged code (usually all of it) stay valid.
+    const unsigned int chunk = 64;
+    for (unsigned int address = 0; address < MEMORY_SIZE; address += chunk) {
+        if (memcmp(&memory[address], &snapshot.memory[address], chunk) != 0) {
+            memcpy(&memory[address], &snapshot.memory[address], chunk);
+            invalidate_blocks(address, chunk);
+        }
     }
 
-    // clear memory
-    for (unsigned int i = 0; i < MEMORY_SIZE; i++) {
-        memory[i] = 0;
+    restore_registers(snapshot);
+}
+
+// Everything but memory
+void Chip8::restore_registers(const Snapshot &snapshot) {
+    display = snapshot.display;
+    memcpy(stack, snapshot.stack, sizeof(stack));
+    memcpy(registers, snapshot.registers, sizeof(registers));
+    memcpy(keypad, snapshot.keypad, sizeof(keypad));
+    memcpy(user_flags, snapshot.user_flags, sizeof(user_flags));
+    memcpy(audio_pattern, snapshot.audio_pattern, sizeof(audio_pattern));
+    index = snapshot.index;
+    pc = snapshot.pc;
+    sp = snapshot.sp;
+    delay_timer = snapshot.delay_timer;
+    sound_timer = snapshot.sound_timer;
+    plane_mask = snapshot.plane_mask;
+    pitch = snapshot.pitch;
+    crash = snapshot.crashed;
+    rand_gen = snapshot.rand_gen;
+    draw_flag = true;
+    mark_drawn(~0ull);
+}
+
+void Chip8::reset() {
+    if (!image) {
+        return;
     }
 
-    // load fonts into memory
-    for (unsigned int i = 0; i < FONTSET_SIZE; i++) {
-        memory[i] = fontset[i];
+    copy_pages(image->memory, written);
+    memset(written, 0, sizeof(written));
+    restore_registers(*image);
+}
+
+void Chip8::copy_from(const Chip8 &source) {
+    if (&source == this) {
+        return;
+    }
+    if (source.quirk_profile != quirk_profile) {
+        set_quirks(source.quirk_profile);
     }
+    core = source.core;
 
-    // Chip8 has an instruction which places a random number into a register.
-    // this will initialize the RNG for the instruction.
-    rand_byte = std::uniform_int_distribution<uint8_t>(0, 255U);
+    uint64_t pages[MEMORY_PAGES / 64];
+    for (unsigned int i = 0; i < MEMORY_PAGES / 64; i++) {
+        // pages neither machine has written are still the shared image's
+        pages[i] = image && image == source.image ? written[i] | source.written[i] : ~0ull;
+    }
+    copy_pages(source.memory, pages);
+    image = source.image;
+    memcpy(written, source.written, sizeof(written));
+
+    display = source.display;
+    memcpy(stack, source.stack, sizeof(stack));
+    memcpy(registers, source.registers, sizeof(registers));
+    memcpy(keypad, source.keypad, sizeof(keypad));
+    memcpy(user_flags, source.user_flags, sizeof(user_flags));
+    memcpy(audio_pattern, source.audio_pattern, sizeof(audio_pattern));
+    index = source.index;
+    pc = source.pc;
+    sp = source.sp;
+    delay_timer = source.delay_timer;
+    sound_timer = source.sound_timer;
+    opcode = source.opcode;
+    plane_mask = source.plane_mask;
+    pitch = source.pitch;
+    crash = source.crash;
+    rand_gen = source.rand_gen;
+    draw_flag = true;
+    mark_drawn(~0ull);
 }
 
-bool Chip8::load_rom(const char *filename) {
-    // Open the file as a stream of binary and move the file pointer to the end
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+// Copy the selected pages of memory over from another image. Pages that
+// are already the same are left alone, so the blocks translated from them
+// stay valid.
+void Chip8::copy_pages(const uint8_t *from, const uint64_t *pages) {
+    for (unsigned int page = 0; page < MEMORY_PAGES; page++) {
+        if ((pages[page / 64] >> (page % 64) & 1u) == 0) {
+            continue;
+        }
+        unsigned int address = page * MEMORY_PAGE_SIZE;
+        if (memcmp(&memory[address], &from[address], MEMORY_PAGE_SIZE) != 0) {
+            memcpy(&memory[address], &from[address], MEMORY_PAGE_SIZE);
+            invalidate_blocks(address, MEMORY_PAGE_SIZE);
+        }
+    }
+}
 
-    if (!file.is_open()) {
-        std::cerr << "Couldn't open file " << filename << std::endl;
-        return false;
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
     }
-    // Get size of file and allocate a buffer to hold the contents
-    std::streampos size = file.tellg();
-    char *buffer = new char[size];
+    return hash;
+}
 
-    // Go back to the beginning of the file and fill the buffer
-    file.seekg(0, std::ios::beg);
-    file.read(buffer, size);
-    file.close();
+// Hash of everything that makes up the machine's state
+uint64_t Chip8::hash() const {
+    uint64_t hash = HASH_SEED;
+    auto add = [&hash](const void *data, size_t size) {
+        hash = hash_bytes(hash, data, size);
+    };
+
+    add(memory, sizeof(memory));
+    add(registers, sizeof(registers));
+    add(&index, sizeof(index));
+    add(&pc, sizeof(pc));
+    add(stack, sizeof(stack));
+    add(&sp, sizeof(sp));
+    add(&delay_timer, sizeof(delay_timer));
+    add(&sound_timer, sizeof(sound_timer));
+    add(display.planes, sizeof(display.planes));
+    add(&display.hires, sizeof(display.hires));
+    add(&plane_mask, sizeof(plane_mask));
+    add(user_flags, sizeof(user_flags));
+    add(audio_pattern, sizeof(audio_pattern));
+    add(&pitch, sizeof(pitch));
+    add(&crash, sizeof(crash));
+    return hash;
+}
 
-    // Load the ROM contents into the Chip8's memory, starting at 0x200
-    for (long i = 0; i < size; ++i) {
-        memory[START_ADDRESS + i] = buffer[i];
+// Hash a memory page or display row a word at a time, seeded with where it is
+static uint64_t hash_words(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &bytes[i], sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+        hash ^= hash >> 29;
     }
+    return hash;
+}
 
-    // Free the buffer
-    delete[] buffer;
-    return true;
+uint64_t Chip8::state_hash() {
+    // Memory and the display are hashed in pieces that are combined with
+    // XOR, so a piece that changed is swapped out of the combined hash
+    // without going over the rest
+    for (unsigned int page = 0; page < MEMORY_PAGES; page++) {
+        if ((stale_pages[page / 64] >> (page % 64) & 1u) == 0) {
+            continue;
+        }
+        uint64_t hash = hash_words(HASH_SEED + page, &memory[page * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE);
+        memory_hash ^= page_hashes[page] ^ hash;
+        page_hashes[page] = hash;
+    }
+    memset(stale_pages, 0, sizeof(stale_pages));
+
+    for (unsigned int row = 0; row < HIRES_HEIGHT; row++) {
+        if ((stale_rows >> row & 1u) == 0) {
+            continue;
+        }
+        uint64_t hash = HASH_SEED + MEMORY_PAGES + row;
+        for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+            hash = hash_words(hash, display.planes[plane][row], sizeof(display.planes[plane][row]));
+        }
+        display_hash ^= row_hashes[row] ^ hash;
+        row_hashes[row] = hash;
+    }
+    stale_rows = 0;
+
+    uint64_t hash = HASH_SEED;
+    auto add = [&hash](const void *data, size_t size) {
+        hash = hash_bytes(hash, data, size);
+    };
+
+    add(&memory_hash, sizeof(memory_hash));
+    add(&display_hash, sizeof(display_hash));
+    add(registers, sizeof(registers));
+    add(&index, sizeof(index));
+    add(&pc, sizeof(pc));
+    add(stack, sizeof(stack));
+    add(&sp, sizeof(sp));
+    add(&delay_timer, sizeof(delay_timer));
+    add(&sound_timer, sizeof(sound_timer));
+    add(&display.hires, sizeof(display.hires));
+    add(&plane_mask, sizeof(plane_mask));
+    add(user_flags, sizeof(user_flags));
+    add(audio_pattern, sizeof(audio_pattern));
+    add(&pitch, sizeof(pitch));
+    add(&crash, sizeof(crash));
+    add(keypad, sizeof(keypad));
+    add(&rand_gen.state, sizeof(rand_gen.state));
+    return hash;
 }
 
-uint8_t Chip8::Vx() {
-    return (opcode & 0x0F00) >> 8;
+bool Chip8::matches(const Snapshot &snapshot) const {
+    return memcmp(memory, snapshot.memory, sizeof(memory)) == 0
+           && memcmp(display.planes, snapshot.display.planes, sizeof(display.planes)) == 0
+           && display.hires == snapshot.display.hires
+           && memcmp(stack, snapshot.stack, sizeof(stack)) == 0
+           && memcmp(registers, snapshot.registers, sizeof(registers)) == 0
+           && memcmp(keypad, snapshot.keypad, sizeof(keypad)) == 0
+           && memcmp(user_flags, snapshot.user_flags, sizeof(user_flags)) == 0
+           && memcmp(audio_pattern, snapshot.audio_pattern, sizeof(audio_pattern)) == 0
+           && index == snapshot.index
+           && pc == snapshot.pc
+           && sp == snapshot.sp
+           && delay_timer == snapshot.delay_timer
+           && sound_timer == snapshot.sound_timer
+           && plane_mask == snapshot.plane_mask
+           && pitch == snapshot.pitch
+           && crash == static_cast<bool>(snapshot.crashed)
+           && quirk_profile == snapshot.quirks
+           && rand_gen.state == snapshot.rand_gen.state;
 }
 
-uint8_t Chip8::Vy() {
-    return (opcode & 0x00F0) >> 4;
+const char *const op_names[OP_COUNT] = {
+        "null",
+        "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk",
+        "7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6",
+        "8xy7", "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E",
+        "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33",
+        "Fx55", "Fx65",
+        "00Cn", "00FB", "00FC", "00FD", "00FE", "00FF", "Fx30", "Fx75",
+        "Fx85",
+        "00Dn", "5xy2", "5xy3", "F000", "Fn01", "F002", "Fx3A",
+};
+
+template <Quirks Q>
+const Chip8::Handler Chip8::handler_table[OP_COUNT] = {
+        &Chip8::op_null,
+        &Chip8::op_00E0, &Chip8::op_00EE, &Chip8::op_1nnn, &Chip8::op_2nnn,
+        &Chip8::op_3xkk, &Chip8::op_4xkk, &Chip8::op_5xy0, &Chip8::op_6xkk,
+        &Chip8::op_7xkk, &Chip8::op_8xy0, &Chip8::op_8xy1<Q>, &Chip8::op_8xy2<Q>,
+        &Chip8::op_8xy3<Q>, &Chip8::op_8xy4<Q>, &Chip8::op_8xy5<Q>, &Chip8::op_8xy6<Q>,
+        &Chip8::op_8xy7<Q>, &Chip8::op_8xyE<Q>, &Chip8::op_9xy0, &Chip8::op_Annn,
+        &Chip8::op_Bnnn<Q>, &Chip8::op_Cxkk, &Chip8::op_Dxyn<Q>, &Chip8::op_Ex9E,
+        &Chip8::op_ExA1, &Chip8::op_Fx07, &Chip8::op_Fx0A, &Chip8::op_Fx15,
+        &Chip8::op_Fx18, &Chip8::op_Fx1E, &Chip8::op_Fx29, &Chip8::op_Fx33,
+        &Chip8::op_Fx55<Q>, &Chip8::op_Fx65<Q>,
+        &Chip8::op_00Cn, &Chip8::op_00FB, &Chip8::op_00FC, &Chip8::op_00FD,
+        &Chip8::op_00FE, &Chip8::op_00FF, &Chip8::op_Fx30, &Chip8::op_Fx75,
+        &Chip8::op_Fx85,
+        &Chip8::op_00Dn, &Chip8::op_5xy2, &Chip8::op_5xy3, &Chip8::op_F000,
+        &Chip8::op_Fn01, &Chip8::op_F002, &Chip8::op_Fx3A,
+};
+
+static const char *const quirks_names[] = {"legacy", "vip", "chip48", "schip", "modern"};
+
+bool parse_quirks(const std::string &name, Quirks &quirks) {
+    for (uint8_t i = 0; i < sizeof(quirks_names) / sizeof(quirks_names[0]); i++) {
+        if (name == quirks_names[i]) {
+            quirks = static_cast<Quirks>(i);
+            return true;
+        }
+    }
+    return false;
 }
 
-uint8_t Chip8::kk() {
-    return opcode & 0x00FF;
+const char *quirks_name(Quirks quirks) {
+    return quirks_names[static_cast<uint8_t>(quirks)];
 }
 
-uint16_t Chip8::nnn() {
-    return opcode & 0xFFF;
+void Chip8::set_quirks(Quirks quirks) {
+    if (quirks == quirk_profile) {
+        // keep the blocks already translated for it
+        return;
+    }
+
+    switch (quirks) {
+        case Quirks::Legacy:
+            handlers = handler_table<Quirks::Legacy>;
+            break;
+        case Quirks::Vip:
+            handlers = handler_table<Quirks::Vip>;
+            break;
+        case Quirks::Chip48:
+            handlers = handler_table<Quirks::Chip48>;
+            break;
+        case Quirks::Schip:
+            handlers = handler_table<Quirks::Schip>;
+            break;
+        case Quirks::Modern:
+            handlers = handler_table<Quirks::Modern>;
+            break;
+    }
+    quirk_profile = quirks;
+
+    // compiled blocks have the old instruction set baked in
+    flush_blocks();
 }
 
-// Fetch, decode, and execute
-void Chip8::cycle() {
-    // fetch the operation
-    opcode = memory[pc] << 8 | memory[pc + 1];
+Quirks Chip8::quirks() const {
+    return quirk_profile;
+}
 
-    // increment the program counter
-    pc += 2;
+// Pick the handler for an opcode and pull out all of its operand fields once,
+// so the handlers never have to decode the opcode themselves.
+Instruction decode(uint16_t opcode) {
+    Instruction in{};
+    in.op = OP_NULL;
+    in.x = (opcode & 0x0F00) >> 8;
+    in.y = (opcode & 0x00F0) >> 4;
+    in.n = opcode & 0x000F;
+    in.kk = opcode & 0x00FF;
+    in.nnn = opcode & 0x0FFF;
 
     switch (opcode & 0xF000) {
         case 0x0000:
+            // SUPER-CHIP and XO-CHIP display instructions
+            switch (opcode & 0xFFF0) {
+                case 0x00C0:
+                    in.op = OP_00Cn;
+                    return in;
+                case 0x00D0:
+                    in.op = OP_00Dn;
+                    return in;
+            }
+            switch (opcode) {
+                case 0x00FB:
+                    in.op = OP_00FB;
+                    return in;
+                case 0x00FC:
+                    in.op = OP_00FC;
+                    return in;
+                case 0x00FD:
+                    in.op = OP_00FD;
+                    return in;
+                case 0x00FE:
+                    in.op = OP_00FE;
+                    return in;
+                case 0x00FF:
+                    in.op = OP_00FF;
+                    return in;
+            }
             switch (opcode & 0x000F) {
                 // 00E0 - Clear Screen
                 case 0x0000:
-                    op_00E0();
+                    in.op = OP_00E0;
                     break;
                     // 00EE return from subroutine
                 case 0x000E:
-                    op_00EE();
+                    in.op = OP_00EE;
                     break;
-                default:
-                    op_null();
             }
             break;
             // 1NNN - Jump to address NNN
         case 0x1000:
-            op_1nnn();
+            in.op = OP_1nnn;
             break;
             // 2NNN - Call subroutine at NNN
         case 0x2000:
-            op_2nnn();
+            in.op = OP_2nnn;
             break;
         case 0x3000:
-            op_3xkk();
+            in.op = OP_3xkk;
             break;
         case 0x4000:
-            op_4xkk();
+            in.op = OP_4xkk;
             break;
         case 0x5000:
-            op_5xy0();
+            switch (opcode & 0x000F) {
+                case 0x0002:
+                    in.op = OP_5xy2;
+                    break;
+                case 0x0003:
+                    in.op = OP_5xy3;
+                    break;
+                default:
+                    in.op = OP_5xy0;
+                    break;
+            }
             break;
         case 0x6000:
-            op_6xkk();
+            in.op = OP_6xkk;
             break;
         case 0x7000:
-            op_7xkk();
+            in.op = OP_7xkk;
             break;
         case 0x8000:
             switch (opcode & 0x000F) {
                 case 0x0000:
-                    op_8xy0();
+                    in.op = OP_8xy0;
                     break;
                 case 0x0001:
-                    op_8xy1();
+                    in.op = OP_8xy1;
                     break;
                 case 0x0002:
-                    op_8xy2();
+                    in.op = OP_8xy2;
                     break;
                 case 0x0003:
-                    op_8xy3();
+                    in.op = OP_8xy3;
                     break;
                 case 0x0004:
-                    op_8xy4();
+                    in.op = OP_8xy4;
                     break;
                 case 0x0005:
-                    op_8xy5();
+                    in.op = OP_8xy5;
                     break;
                 case 0x0006:
-                    op_8xy6();
+                    in.op = OP_8xy6;
                     break;
                 case 0x0007:
-                    op_8xy7();
+                    in.op = OP_8xy7;
                     break;
                 case 0x000E:
-                    op_8xyE();
+                    in.op = OP_8xyE;
                     break;
-                default:
-                    op_null();
             }
             break;
         case 0x9000:
-            op_9xy0();
+            in.op = OP_9xy0;
             break;
         case 0xA000:
-            op_Annn();
+            in.op = OP_Annn;
             break;
         case 0xB000:
-            op_Bnnn();
+            in.op = OP_Bnnn;
             break;
         case 0xC000:
-            op_Cxkk();
+            in.op = OP_Cxkk;
             break;
         case 0xD000:
-            op_Dxyn();
+            in.op = OP_Dxyn;
             break;
         case 0xE000:
             switch (opcode & 0x00FF) {
                 case 0x009E:
-                    op_Ex9E();
+                    in.op = OP_Ex9E;
                     break;
                 case 0x00A1:
-                    op_ExA1();
+                    in.op = OP_ExA1;
                     break;
-                default:
-                    op_null();
             }
             break;
         case 0xF000:
             switch (opcode & 0x00FF) {
+                case 0x0000:
+                    // only F000 itself, it's followed by the address
+                    in.op = opcode == 0xF000 ? OP_F000 : OP_NULL;
+                    break;
+                case 0x0001:
+                    in.op = OP_Fn01;
+                    break;
+                case 0x0002:
+                    in.op = opcode == 0xF002 ? OP_F002 : OP_NULL;
+                    break;
                 case 0x0007:
-                    op_Fx07();
+                    in.op = OP_Fx07;
                     break;
                 case 0x000A:
-                    op_Fx0A();
+                    in.op = OP_Fx0A;
                     break;
                 case 0x0015:
-                    op_Fx15();
+                    in.op = OP_Fx15;
                     break;
                 case 0x0018:
-                    op_Fx18();
+                    in.op = OP_Fx18;
                     break;
                 case 0x001E:
-                    op_Fx1E();
+                    in.op = OP_Fx1E;
                     break;
                 case 0x0029:
-                    op_Fx29();
+                    in.op = OP_Fx29;
                     break;
                 case 0x0033:
-                    op_Fx33();
+                    in.op = OP_Fx33;
                     break;
                 case 0x0055:
-                    op_Fx55();
+                    in.op = OP_Fx55;
                     break;
                 case 0x0065:
-                    op_Fx65();
+                    in.op = OP_Fx65;
+                    break;
+                case 0x0030:
+                    in.op = OP_Fx30;
+                    break;
+                case 0x003A:
+                    in.op = OP_Fx3A;
+                    break;
+                case 0x0075:
+                    in.op = OP_Fx75;
+                    break;
+                case 0x0085:
+                    in.op = OP_Fx85;
                     break;
-                default:
-                    op_null();
             }
             break;
+    }
+    return in;
+}
+
+// Every possible opcode decoded ahead of time (512 KB, but only the handful
+// of entries a ROM actually uses are ever pulled into the cache).
+const std::vector<Instruction> decode_table = [] {
+    std::vector<Instruction> table(0x10000);
+    for (uint32_t opcode = 0; opcode < 0x10000; opcode++) {
+        table[opcode] = decode(opcode);
+    }
+    return table;
+}();
+
+bool writes_vx(uint8_t op) {
+    switch (op) {
+        case OP_6xkk:
+        case OP_7xkk:
+        case OP_8xy0:
+        case OP_8xy1:
+        case OP_8xy2:
+        case OP_8xy3:
+        case OP_8xy4:
+        case OP_8xy5:
+        case OP_8xy6:
+        case OP_8xy7:
+        case OP_8xyE:
+        case OP_Cxkk:
+        case OP_Fx07:
+        case OP_Fx0A:
+        case OP_Fx65:
+        case OP_Fx85:
+        case OP_5xy3:
+            return true;
         default:
-            op_null();
+            return false;
+    }
+}
+
+// Write an opcode out in the mnemonics the handlers are documented with
+std::string disassemble(uint16_t opcode) {
+    Instruction in = decode(opcode);
+    char text[32];
+    switch (in.op) {
+        case OP_00E0: return "CLS";
+        case OP_00EE: return "RET";
+        case OP_1nnn: snprintf(text, sizeof(text), "JP 0x%03X", in.nnn); break;
+        case OP_2nnn: snprintf(text, sizeof(text), "CALL 0x%03X", in.nnn); break;
+        case OP_3xkk: snprintf(text, sizeof(text), "SE V%X, 0x%02X", in.x, in.kk); break;
+        case OP_4xkk: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", in.x, in.kk); break;
+        case OP_5xy0: snprintf(text, sizeof(text), "SE V%X, V%X", in.x, in.y); break;
+        case OP_6xkk: snprintf(text, sizeof(text), "LD V%X, 0x%02X", in.x, in.kk); break;
+        case OP_7xkk: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", in.x, in.kk); break;
+        case OP_8xy0: snprintf(text, sizeof(text), "LD V%X, V%X", in.x, in.y); break;
+        case OP_8xy1: snprintf(text, sizeof(text), "OR V%X, V%X", in.x, in.y); break;
+        case OP_8xy2: snprintf(text, sizeof(text), "AND V%X, V%X", in.x, in.y); break;
+        case OP_8xy3: snprintf(text, sizeof(text), "XOR V%X, V%X", in.x, in.y); break;
+        case OP_8xy4: snprintf(text, sizeof(text), "ADD V%X, V%X", in.x, in.y); break;
+        case OP_8xy5: snprintf(text, sizeof(text), "SUB V%X, V%X", in.x, in.y); break;
+        case OP_8xy6: snprintf(text, sizeof(text), "SHR V%X", in.x); break;
+        case OP_8xy7: snprintf(text, sizeof(text), "SUBN V%X, V%X", in.x, in.y); break;
+        case OP_8xyE: snprintf(text, sizeof(text), "SHL V%X", in.x); break;
+        case OP_9xy0: snprintf(text, sizeof(text), "SNE V%X, V%X", in.x, in.y); break;
+        case OP_Annn: snprintf(text, sizeof(text), "LD I, 0x%03X", in.nnn); break;
+        case OP_Bnnn: snprintf(text, sizeof(text), "JP V0, 0x%03X", in.nnn); break;
+        case OP_Cxkk: snprintf(text, sizeof(text), "RND V%X, 0x%02X", in.x, in.kk); break;
+        case OP_Dxyn: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", in.x, in.y, in.n); break;
+        case OP_Ex9E: snprintf(text, sizeof(text), "SKP V%X", in.x); break;
+        case OP_ExA1: snprintf(text, sizeof(text), "SKNP V%X", in.x); break;
+        case OP_Fx07: snprintf(text, sizeof(text), "LD V%X, DT", in.x); break;
+        case OP_Fx0A: snprintf(text, sizeof(text), "LD V%X, K", in.x); break;
+        case OP_Fx15: snprintf(text, sizeof(text), "LD DT, V%X", in.x); break;
+        case OP_Fx18: snprintf(text, sizeof(text), "LD ST, V%X", in.x); break;
+        case OP_Fx1E: snprintf(text, sizeof(text), "ADD I, V%X", in.x); break;
+        case OP_Fx29: snprintf(text, sizeof(text), "LD F, V%X", in.x); break;
+        case OP_Fx33: snprintf(text, sizeof(text), "LD B, V%X", in.x); break;
+        case OP_Fx55: snprintf(text, sizeof(text), "LD [I], V%X", in.x); break;
+        case OP_Fx65: snprintf(text, sizeof(text), "LD V%X, [I]", in.x); break;
+        case OP_00Cn: snprintf(text, sizeof(text), "SCD %u", in.n); break;
+        case OP_00FB: return "SCR";
+        case OP_00FC: return "SCL";
+        case OP_00FD: return "EXIT";
+        case OP_00FE: return "LOW";
+        case OP_00FF: return "HIGH";
+        case OP_Fx30: snprintf(text, sizeof(text), "LD HF, V%X", in.x); break;
+        case OP_Fx75: snprintf(text, sizeof(text), "LD R, V%X", in.x); break;
+        case OP_Fx85: snprintf(text, sizeof(text), "LD V%X, R", in.x); break;
+        case OP_00Dn: snprintf(text, sizeof(text), "SCU %u", in.n); break;
+        case OP_5xy2: snprintf(text, sizeof(text), "LD [I], V%X-V%X", in.x, in.y); break;
+        case OP_5xy3: snprintf(text, sizeof(text), "LD V%X-V%X, [I]", in.x, in.y); break;
+        case OP_F000: return "LD I, LONG";
+        case OP_Fn01: snprintf(text, sizeof(text), "PLANE %u", in.x); break;
+        case OP_F002: return "AUDIO";
+        case OP_Fx3A: snprintf(text, sizeof(text), "PITCH V%X", in.x); break;
+        default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+    }
+    return text;
+}
+
+void Chip8::execute(const Instruction &in) {
+    (this->*handlers[in.op])(in);
+}
+
+// Count the timers down, once per 60 Hz frame
+void Chip8::tick_timers() {
+    if (crash) {
+        return;
     }
 
     // decrement the delay timer if it's been set
@@ -273,218 +747,1113 @@ void Chip8::cycle() {
     }
 }
 
+// Fetch, decode, and execute
+void Chip8::cycle() {
+    if (crash) {
+        return;
+    }
+
+    uint16_t address = pc;
+#ifdef CHIP8_PROFILE
+    uint64_t start = profiler ? profiler_ticks() : 0;
+#endif
+
+    // fetch the operation
+    opcode = memory[pc] << 8 | memory[static_cast<uint16_t>(pc + 1)];
+
+    // increment the program counter
+    pc += 2;
+
+    if (core == Core::Switch) {
+        interpret();
+    } else {
+        execute(decode_table[opcode]);
+    }
+
+    if (tracer) {
+        const Instruction &in = decode_table[opcode];
+        tracer->record({address, opcode, index, writes_vx(in.op) ? registers[in.x] : uint8_t(0), registers[0xF]});
+    }
+
+#ifdef CHIP8_PROFILE
+    if (profiler) {
+        profiler->record(address, decode_table[opcode].op, profiler_ticks() - start,
+                         pc, stack, sp, memory);
+    }
+#endif
+}
+
+uint8_t Chip8::Vx() const {
+    return (opcode & 0x0F00) >> 8;
+}
+
+uint8_t Chip8::Vy() const {
+    return (opcode & 0x00F0) >> 4;
+}
+
+uint8_t Chip8::kk() const {
+    return opcode & 0x00FF;
+}
+
+uint16_t Chip8::nnn() const {
+    return opcode & 0xFFF;
+}
+
+// Decode and execute the opcode just fetched, with pc already past it
+//
+// This is the interpreter the emulator started out with, grown to the
+// SUPER-CHIP and XO-CHIP instructions and the quirks. It shares nothing with
+// decode() and the handlers, and draws and scrolls a pixel at a time, so
+// that every other core can be checked against it.
+void Chip8::interpret() {
+    const QuirkSet &quirks = quirk_set(quirk_profile);
+
+    // skips step over both halves of XO-CHIP's F000 NNNN
+    auto skip = [this]() {
+        pc += memory[pc] == 0xF0 && memory[static_cast<uint16_t>(pc + 1)] == 0x00 ? 4 : 2;
+    };
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            // SUPER-CHIP and XO-CHIP display instructions
+            switch (opcode & 0xFFF0) {
+                case 0x00C0:
+                    scroll_pixels(0, opcode & 0x000F);
+                    return;
+                case 0x00D0:
+                    scroll_pixels(0, -(opcode & 0x000F));
+                    return;
+            }
+            switch (opcode) {
+                case 0x00FB:
+                    scroll_pixels(4, 0);
+                    return;
+                case 0x00FC:
+                    scroll_pixels(-4, 0);
+                    return;
+                case 0x00FD:
+                    // stay on this instruction for good
+                    pc -= 2;
+                    return;
+                case 0x00FE:
+                case 0x00FF:
+                    display.hires = opcode == 0x00FF;
+                    memset(display.planes, 0, sizeof(display.planes));
+                    mark_drawn(~0ull);
+                    draw_flag = true;
+                    return;
+            }
+            switch (opcode & 0x000F) {
+                // 00E0 - Clear Screen
+                case 0x0000:
+                    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                        if ((plane_mask >> plane) & 1u) {
+                            memset(display.planes[plane], 0, sizeof(display.planes[plane]));
+                        }
+                    }
+                    mark_drawn(~0ull);
+                    draw_flag = true;
+                    break;
+                    // 00EE return from subroutine
+                case 0x000E:
+                    --sp;
+                    pc = stack[sp % STACK_LEVELS];
+                    break;
+                default:
+                    op_null({});
+            }
+            break;
+            // 1NNN - Jump to address NNN
+        case 0x1000:
+            pc = nnn();
+            break;
+            // 2NNN - Call subroutine at NNN
+        case 0x2000:
+            stack[sp % STACK_LEVELS] = pc;
+            ++sp;
+            pc = nnn();
+            break;
+        case 0x3000:
+            if (registers[Vx()] == kk()) {
+                skip();
+            }
+            break;
+        case 0x4000:
+            if (registers[Vx()] != kk()) {
+                skip();
+            }
+            break;
+        case 0x5000: {
+            // XO-CHIP's register range load and store, in reverse when x > y
+            int step = Vx() <= Vy() ? 1 : -1;
+            unsigned int count = (Vx() <= Vy() ? Vy() - Vx() : Vx() - Vy()) + 1;
+            switch (opcode & 0x000F) {
+                case 0x0002:
+                    for (unsigned int i = 0; i < count; i++) {
+                        memory[static_cast<uint16_t>(index + i)] = registers[Vx() + step * static_cast<int>(i)];
+                    }
+                    invalidate_blocks(index, count);
+                    break;
+                case 0x0003:
+                    for (unsigned int i = 0; i < count; i++) {
+                        registers[Vx() + step * static_cast<int>(i)] = memory[static_cast<uint16_t>(index + i)];
+                    }
+                    break;
+                default:
+                    if (registers[Vx()] == registers[Vy()]) {
+                        skip();
+                    }
+            }
+            break;
+        }
+        case 0x6000:
+            registers[Vx()] = kk();
+            break;
+        case 0x7000:
+            registers[Vx()] += kk();
+            break;
+        case 0x8000: {
+            // VF is written in the same order as on the machine being
+            // emulated, which decides what's left in it when x or y is F
+            uint8_t source = quirks.shift_vy ? Vy() : Vx();
+            uint8_t flag = 0;
+            switch (opcode & 0x000F) {
+                case 0x0000:
+                    registers[Vx()] = registers[Vy()];
+                    break;
+                case 0x0001:
+                    registers[Vx()] |= registers[Vy()];
+                    if (quirks.vf_reset) {
+                        registers[VF] = 0;
+                    }
+                    break;
+                case 0x0002:
+                    registers[Vx()] &= registers[Vy()];
+                    if (quirks.vf_reset) {
+                        registers[VF] = 0;
+                    }
+                    break;
+                case 0x0003:
+                    registers[Vx()] ^= registers[Vy()];
+                    if (quirks.vf_reset) {
+                        registers[VF] = 0;
+                    }
+                    break;
+                case 0x0004: {
+                    uint8_t sum = registers[Vx()] + registers[Vy()];
+                    flag = registers[Vx()] + registers[Vy()] > 0xFF ? 1 : 0;
+                    if (quirks.flag_last) {
+                        registers[Vx()] = sum;
+                        registers[VF] = flag;
+                    } else {
+                        registers[VF] = flag;
+                        registers[Vx()] = sum;
+                    }
+                    break;
+                }
+                case 0x0005:
+                    if (quirks.flag_last) {
+                        flag = registers[Vx()] >= registers[Vy()] ? 1 : 0;
+                        registers[Vx()] -= registers[Vy()];
+                        registers[VF] = flag;
+                    } else {
+                        registers[VF] = registers[Vx()] >= registers[Vy()] ? 1 : 0;
+                        registers[Vx()] -= registers[Vy()];
+                    }
+                    break;
+                case 0x0006:
+                    if (quirks.flag_last) {
+                        flag = registers[source] & 0x1;
+                        registers[Vx()] = registers[source] >> 1;
+                        registers[VF] = flag;
+                    } else {
+                        registers[VF] = registers[source] & 0x1;
+                        registers[Vx()] = registers[source] >> 1;
+                    }
+                    break;
+                case 0x0007:
+                    if (quirks.flag_last) {
+                        flag = registers[Vy()] > registers[Vx()] ? 1 : 0;
+                        registers[Vx()] = registers[Vy()] - registers[Vx()];
+                        registers[VF] = flag;
+                    } else {
+                        registers[VF] = registers[Vy()] > registers[Vx()] ? 1 : 0;
+                        registers[Vx()] = registers[Vy()] - registers[Vx()];
+                    }
+                    break;
+                case 0x000E:
+                    if (quirks.flag_last) {
+                        flag = registers[source] >> 7;
+                        registers[Vx()] = registers[source] << 1;
+                        registers[VF] = flag;
+                    } else {
+                        registers[VF] = registers[source] >> 7;
+                        registers[Vx()] = registers[source] << 1;
+                    }
+                    break;
+                default:
+                    op_null({});
+            }
+            break;
+        }
+        case 0x9000:
+            if (registers[Vx()] != registers[Vy()]) {
+                skip();
+            }
+            break;
+        case 0xA000:
+            index = nnn();
+            break;
+        case 0xB000:
+            pc = nnn() + (quirks.jump_vx ? registers[Vx()] : registers[0]);
+            break;
+        case 0xC000:
+            registers[Vx()] = rand_gen.next_byte() & kk();
+            break;
+        case 0xD000:
+            registers[VF] = draw_pixels(registers[Vx()], registers[Vy()], opcode & 0x000F) ? 1 : 0;
+            draw_flag = true;
+            break;
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x009E:
+                    if (registers[Vx()] < KEY_COUNT && keypad[registers[Vx()]]) {
+                        skip();
+                    }
+                    break;
+                case 0x00A1:
+                    if (registers[Vx()] >= KEY_COUNT || !keypad[registers[Vx()]]) {
+                        skip();
+                    }
+                    break;
+                default:
+                    op_null({});
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0000:
+                    if (opcode != 0xF000) {
+                        op_null({});
+                        break;
+                    }
+                    // I = the 16-bit word after the instruction
+                    index = memory[pc] << 8u | memory[static_cast<uint16_t>(pc + 1)];
+                    pc += 2;
+                    break;
+                case 0x0001:
+                    plane_mask = Vx() & ((1u << PLANE_COUNT) - 1);
+                    break;
+                case 0x0002:
+                    if (opcode != 0xF002) {
+                        op_null({});
+                        break;
+                    }
+                    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+                        audio_pattern[i] = memory[static_cast<uint16_t>(index + i)];
+                    }
+                    break;
+                case 0x0007:
+                    registers[Vx()] = delay_timer;
+                    break;
+                case 0x000A: {
+                    // wait here until a key is pressed
+                    unsigned int key = 0;
+                    while (key < KEY_COUNT && keypad[key] == 0) {
+                        key++;
+                    }
+                    if (key < KEY_COUNT) {
+                        registers[Vx()] = key;
+                    } else {
+                        pc -= 2;
+                    }
+                    break;
+                }
+                case 0x0015:
+                    delay_timer = registers[Vx()];
+                    break;
+                case 0x0018:
+                    sound_timer = registers[Vx()];
+                    break;
+                case 0x001E:
+                    registers[VF] = index + registers[Vx()] > 0xFFF ? 1 : 0;
+                    index += registers[Vx()];
+                    break;
+                case 0x0029:
+                    index = registers[Vx()] * 5;
+                    break;
+                case 0x0030:
+                    index = FONTSET_SIZE + (registers[Vx()] & 0xFu) * 10;
+                    break;
+                case 0x0033:
+                    memory[index] = registers[Vx()] / 100;
+                    memory[static_cast<uint16_t>(index + 1)] = registers[Vx()] / 10 % 10;
+                    memory[static_cast<uint16_t>(index + 2)] = registers[Vx()] % 10;
+                    invalidate_blocks(index, 3);
+                    break;
+                case 0x003A:
+                    pitch = registers[Vx()];
+                    break;
+                case 0x0055:
+                    for (unsigned int i = 0; i <= Vx(); i++) {
+                        memory[static_cast<uint16_t>(index + i)] = registers[i];
+                    }
+                    invalidate_blocks(index, Vx() + 1);
+                    index = index_after_load_store(quirks.load_store, index, Vx());
+                    break;
+                case 0x0065:
+                    for (unsigned int i = 0; i <= Vx(); i++) {
+                        registers[i] = memory[static_cast<uint16_t>(index + i)];
+                    }
+                    index = index_after_load_store(quirks.load_store, index, Vx());
+                    break;
+                case 0x0075:
+                    memcpy(user_flags, registers, Vx() + 1);
+                    break;
+                case 0x0085:
+                    memcpy(registers, user_flags, Vx() + 1);
+                    break;
+                default:
+                    op_null({});
+            }
+            break;
+        default:
+            op_null({});
+    }
+}
+
+// Whether pixel (x, y) of a plane is on
+static bool pixel(const Display &display, unsigned int plane, unsigned int x, unsigned int y) {
+    return (display.planes[plane][y][x / 64] >> (63 - x % 64)) & 1u;
+}
+
+static void flip_pixel(Display &display, unsigned int plane, unsigned int x, unsigned int y) {
+    display.planes[plane][y][x / 64] ^= 1ull << (63 - x % 64);
+}
+
+static void set_pixel(Display &display, unsigned int plane, unsigned int x, unsigned int y, bool on) {
+    if (pixel(display, plane, x, y) != on) {
+        flip_pixel(display, plane, x, y);
+    }
+}
+
+// Draw a sprite for interpret() one pixel at a time, the way the emulator
+// first did, with Dxy0 drawing 16x16. Returns whether a pixel was turned off.
+bool Chip8::draw_pixels(uint8_t x, uint8_t y, uint8_t n) {
+    bool wrap = quirk_set(quirk_profile).wrap_sprites;
+    unsigned int width = display.width();
+    unsigned int height = display.height();
+    unsigned int size = n == 0 ? 16 : 8;
+    unsigned int rows = n == 0 ? 16 : n;
+    unsigned int left = x % width;
+    unsigned int top = y % height;
+
+    bool collision = false;
+    uint16_t address = index;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (((plane_mask >> plane) & 1u) == 0) {
+            continue;
+        }
+        for (unsigned int row = 0; row < rows; row++) {
+            unsigned int bits = memory[address++];
+            if (size == 16) {
+                bits = bits << 8u | memory[address++];
+            }
+            unsigned int line = top + row;
+            if (line >= height && !wrap) {
+                continue;
+            }
+            line %= height;
+            for (unsigned int col = 0; col < size; col++) {
+                unsigned int column = left + col;
+                if ((bits >> (size - 1 - col) & 1u) == 0 || (column >= width && !wrap)) {
+                    continue;
+                }
+                column %= width;
+                collision |= pixel(display, plane, column, line);
+                flip_pixel(display, plane, column, line);
+                mark_drawn(1ull << line);
+            }
+        }
+    }
+    return collision;
+}
+
+// Scroll the selected planes for interpret() one pixel at a time, right by
+// dx and down by dy, filling in with pixels that are off
+void Chip8::scroll_pixels(int dx, int dy) {
+    int width = display.width();
+    int height = display.height();
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (((plane_mask >> plane) & 1u) == 0) {
+            continue;
+        }
+        // go against the direction of the scroll, so nothing is read after
+        // it has been written
+        for (int i = 0; i < height; i++) {
+            int row = dy > 0 ? height - 1 - i : i;
+            for (int j = 0; j < width; j++) {
+                int col = dx > 0 ? width - 1 - j : j;
+                int from_row = row - dy;
+                int from_col = col - dx;
+                bool on = from_row >= 0 && from_row < height && from_col >= 0 && from_col < width
+                          && pixel(display, plane, from_col, from_row);
+                set_pixel(display, plane, col, row, on);
+            }
+        }
+    }
+    if (plane_mask != 0) {
+        mark_drawn(~0ull);
+    }
+    draw_flag = true;
+}
+
+// Execute one frame's worth of instructions, then tick the timers
+void Chip8::run_frame(unsigned int cycles) {
+    run(cycles);
+    tick_timers();
+}
+
+// Execute the given number of instructions
+void Chip8::run(unsigned int cycles) {
+    // only the interpreter is instrumented
+    bool interpret = (core != Core::Block && core != Core::Jit) || tracer != nullptr;
+#ifdef CHIP8_PROFILE
+    interpret = interpret || profiler != nullptr;
+#endif
+    if (interpret) {
+        // every instruction counts when something's watching, so idle loops
+        // are only skipped without a tracer or profiler
+        bool instrumented = tracer != nullptr;
+#ifdef CHIP8_PROFILE
+        instrumented = instrumented || profiler != nullptr;
+#endif
+        for (unsigned int i = 0; i < cycles && !crash; i++) {
+            uint16_t address = pc;
+            cycle();
+            if (pc <= address && !instrumented) {
+                i += idle_cycles(cycles - i - 1);
+            }
+        }
+        return;
+    }
+
+    // shorter runs stick to the blocks, see JIT_MIN_CYCLES
+    const bool native = core == Core::Jit && cycles >= jit_min_cycles;
+    while (cycles > 0) {
+        Block *block = find_block(pc);
+        if (block == nullptr) {
+            // nothing translatable here (e.g. an unknown opcode), so let
+            // the interpreter deal with it
+            cycle();
+            if (crash) {
+                return;
+            }
+            cycles--;
+            continue;
+        }
+
+        // only blocks starting the way an idle loop does are checked, the
+        // rest can't be one
+        if (block->may_idle) {
+            cycles -= idle_cycles(cycles);
+            if (cycles == 0) {
+                break;
+            }
+        }
+
+        // a block may be cut short by the cycle budget, or by one of its own
+        // instructions writing over code that has already been translated.
+        // A skip that's taken steps over the next op, so ops and cycles are
+        // counted apart.
+        const unsigned int size = block->ops.size();
+        unsigned int next = 0;
+        unsigned int executed = 0;
+
+        if (native) {
+            if (block->hits < JIT_THRESHOLD && ++block->hits == JIT_THRESHOLD) {
+                compile_block(*block, pc);
+            }
+            // the native code runs whole blocks, one after the other, and
+            // comes back with pc set and what's left of the budget. It hasn't
+            // run anything if the budget doesn't cover the block.
+            if (block->jit != nullptr) {
+                jit_budget = cycles;
+                block->jit(this);
+                if (jit_budget < cycles) {
+                    cycles = jit_budget;
+                    continue;
+                }
+            }
+        }
+
+        const Instruction *ops = block->ops.data();
+        while (next < size && executed < cycles) {
+            const Instruction &in = ops[next++];
+            executed++;
+            pc += 2;
+            // the most common register operations and the skips are run
+            // inline, everything else goes through the regular handlers
+            switch (in.op) {
+                case OP_3xkk:
+                    if (registers[in.x] == in.kk) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_4xkk:
+                    if (registers[in.x] != in.kk) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_5xy0:
+                    if (registers[in.x] == registers[in.y]) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_9xy0:
+                    if (registers[in.x] != registers[in.y]) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_Ex9E:
+                    if (registers[in.x] < KEY_COUNT && keypad[registers[in.x]]) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_ExA1:
+                    if (registers[in.x] >= KEY_COUNT || !keypad[registers[in.x]]) {
+                        pc += instruction_length(pc);
+                        next++;
+                    }
+                    break;
+                case OP_6xkk:
+                    registers[in.x] = in.kk;
+                    break;
+                case OP_7xkk:
+                    registers[in.x] += in.kk;
+                    break;
+                case OP_8xy0:
+                    registers[in.x] = registers[in.y];
+                    break;
+                case OP_Annn:
+                    index = in.nnn;
+                    break;
+                case OP_1nnn:
+                    pc = in.nnn;
+                    break;
+                default:
+                    execute(in);
+                    // only a handler can write over the block
+                    if (!block->valid) {
+                        next = size;
+                    }
+            }
+        }
+        cycles -= executed;
+    }
+}
+
+// Nothing but the frontend changes the keypad or ticks the timers, so
+// within a run a machine can get stuck in a loop that does the same thing
+// over and over until the run ends: waiting for a key, jumping to itself,
+// or polling the delay timer. Running that loop to the end leaves the
+// machine in a state that's known up front, so it's set directly and the
+// instructions are skipped, without changing anything the machine does.
+unsigned int Chip8::idle_cycles(unsigned int cycles) {
+    auto at = [this](unsigned int offset) -> const Instruction & {
+        uint16_t address = pc + offset;
+        return decode_table[memory[address] << 8 | memory[static_cast<uint16_t>(address + 1)]];
+    };
+
+    const Instruction &in = at(0);
+    switch (in.op) {
+        case OP_1nnn:
+            return in.nnn == pc ? cycles : 0;
+        case OP_00FD:
+            return cycles;
+        case OP_Fx0A:
+            for (unsigned int key = 0; key < KEY_COUNT; key++) {
+                if (keypad[key] != 0) {
+                    return 0;
+                }
+            }
+            return cycles;
+        case OP_Fx07: {
+            // LD Vx, DT / SE or SNE Vy, kk / JP back, for as long as the
+            // skip doesn't jump out of the loop
+            const Instruction &test = at(2);
+            const Instruction &jump = at(4);
+            if ((test.op != OP_3xkk && test.op != OP_4xkk) || jump.op != OP_1nnn || jump.nnn != pc) {
+                return 0;
+            }
+            uint8_t value = test.x == in.x ? delay_timer : registers[test.x];
+            if ((value == test.kk) == (test.op == OP_3xkk)) {
+                return 0;
+            }
+
+            // each time around only loads the timer again
+            unsigned int loops = cycles / 3;
+            if (loops > 0) {
+                registers[in.x] = delay_timer;
+            }
+            return loops * 3;
+        }
+        default:
+            return 0;
+    }
+}
+
+//region Block cache
+
+// Instructions that can change the program counter end a block, except for
+// the skips, see find_block()
+static bool ends_block(uint8_t op) {
+    switch (op) {
+        case OP_00EE:
+        case OP_1nnn:
+        case OP_2nnn:
+        case OP_3xkk:
+        case OP_4xkk:
+        case OP_5xy0:
+        case OP_9xy0:
+        case OP_Bnnn:
+        case OP_Ex9E:
+        case OP_ExA1:
+        case OP_Fx0A:
+        case OP_00FD:
+        case OP_F000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Instructions that skip the next one
+static bool skips(uint8_t op) {
+    switch (op) {
+        case OP_3xkk:
+        case OP_4xkk:
+        case OP_5xy0:
+        case OP_9xy0:
+        case OP_Ex9E:
+        case OP_ExA1:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Bytes a block can depend on: its longest run of instructions and the
+// instruction after a final skip
+const unsigned int MAX_BLOCK_REACH = 2 * MAX_BLOCK_LENGTH + 2;
+
+// Look up the block starting at address, translating it if needed
+Chip8::Block *Chip8::find_block(uint16_t address) {
+    if (address >= CODE_SIZE) {
+        return nullptr;
+    }
+    if (blocks.empty()) {
+        blocks.resize(CODE_SIZE);
+        // room for the last instruction and the one a skip there depends on
+        code_map.assign(CODE_SIZE + 3, 0);
+    }
+
+    Block &block = blocks[address];
+    if (block.valid) {
+        return &block;
+    }
+
+    block.ops.clear();
+    block.may_idle = false;
+    block.jit = nullptr;
+    block.hits = 0;
+    unsigned int end = address;
+    while (end < CODE_SIZE && block.ops.size() < MAX_BLOCK_LENGTH) {
+        Instruction in = decode_table[memory[end] << 8 | memory[end + 1]];
+        if (in.op == OP_NULL) {
+            // leave unknown opcodes for the interpreter to report
+            break;
+        }
+        block.ops.push_back(in);
+        end += 2;
+        // a skip carries on with the instruction it may skip, so that
+        // together they make up a conditional jump or operation
+        if (ends_block(in.op) && !skips(in.op)) {
+            break;
+        }
+    }
+
+    if (block.ops.empty()) {
+        return nullptr;
+    }
+
+    // the loops idle_cycles() looks for
+    const Instruction &first = block.ops.front();
+    block.may_idle = (first.op == OP_1nnn && first.nnn == address) || first.op == OP_00FD
+                     || first.op == OP_Fx0A || first.op == OP_Fx07;
+
+    // a compiled skip knows how far it goes from the instruction after it,
+    // so writing over that one has to drop the block as well
+    if (skips(block.ops.back().op)) {
+        end += 2;
+    }
+
+    block.end = end;
+    block.valid = true;
+    for (unsigned int i = address; i < end; i++) {
+        code_map[i]++;
+    }
+    return &block;
+}
+
+// Drop every block that overlaps memory written by the running program, and
+// remember the pages as written
+void Chip8::invalidate_blocks(unsigned int address, unsigned int length) {
+    // a write that runs past the top of memory carries on at 0
+    if (address + length > MEMORY_SIZE) {
+        unsigned int wrapped = address + length - MEMORY_SIZE;
+        invalidate_blocks(0, wrapped);
+        length -= wrapped;
+    }
+    mark_written(address, length);
+    if (address >= code_map.size()) {
+        return;
+    }
+
+    unsigned int end = address + length < code_map.size() ? address + length : code_map.size();
+    bool covered = false;
+    for (unsigned int i = address; i < end; i++) {
+        covered |= code_map[i] != 0;
+    }
+    if (!covered) {
+        return;
+    }
+
+    // only blocks starting up to MAX_BLOCK_REACH bytes back can reach into
+    // the written range
+    unsigned int first = address > MAX_BLOCK_REACH ? address - MAX_BLOCK_REACH : 0;
+    for (unsigned int start = first; start < end && start < CODE_SIZE; start++) {
+        Block &block = blocks[start];
+        if (block.valid && block.end > address) {
+            // keep the ops around, the block may still be executing
+            block.valid = false;
+            if (block.jit != nullptr) {
+                jit->unlink(start);
+                block.jit = nullptr;
+            }
+            for (unsigned int i = start; i < block.end; i++) {
+                code_map[i]--;
+            }
+        }
+    }
+}
+
+void Chip8::mark_written(unsigned int address, unsigned int length) {
+    if (length == 0) {
+        return;
+    }
+    unsigned int last = (address + length - 1) / MEMORY_PAGE_SIZE;
+    for (unsigned int page = address / MEMORY_PAGE_SIZE; page <= last; page++) {
+        unsigned int wrapped = page % MEMORY_PAGES;
+        written[wrapped / 64] |= 1ull << (wrapped % 64);
+        stale_pages[wrapped / 64] |= 1ull << (wrapped % 64);
+    }
+}
+
+void Chip8::flush_blocks() {
+    blocks.clear();
+    code_map.clear();
+    if (jit) {
+        jit->clear();
+    }
+}
+
+// Compile a hot block to native code. Idle loops aren't jumped into from
+// other blocks, they have to go through the run loop to be skipped.
+void Chip8::compile_block(Block &block, uint16_t address) {
+    if (!jit) {
+        jit = std::make_unique<Jit>();
+    }
+    if (!jit->supported()) {
+        return;
+    }
+
+    block.jit = jit->compile(*this, block.ops.data(), block.ops.size(), address, !block.may_idle);
+    if (block.jit == nullptr && jit->full()) {
+        // start over with an empty buffer; other blocks get recompiled
+        // once they're hot again
+        for (Block &other : blocks) {
+            other.jit = nullptr;
+            other.hits = 0;
+        }
+        jit->clear();
+        block.jit = jit->compile(*this, block.ops.data(), block.ops.size(), address, !block.may_idle);
+        block.hits = JIT_THRESHOLD;
+    }
+}
+
+//endregion
+
 //region Instructions
 
 // Clear the display
-void Chip8::op_00E0() {
-    // we can simply set the entire video buffer to zeroes.
-    memset(video, 0, sizeof(video));
+void Chip8::op_00E0(const Instruction &in) {
+    // only the selected planes are cleared
+    mark_drawn(display.clear(plane_mask));
     draw_flag = true;
 }
 
 // Return from subroutine
-void Chip8::op_00EE() {
-    // decrement the stack pointer and reassign the program counter
+void Chip8::op_00EE(const Instruction &in) {
+    // decrement the stack pointer and reassign the program counter, the
+    // stack wraps around when a program returns more often than it calls
     --sp;
-    pc = stack[sp];
+    pc = stack[sp % STACK_LEVELS];
 }
 
 // Jump to location nnn
 // A jump doesn’t remember its origin, so no stack interaction required.
-void Chip8::op_1nnn() {
-    pc = nnn();
+void Chip8::op_1nnn(const Instruction &in) {
+    pc = in.nnn;
 }
 
 // Call subroutine at nnn
-void Chip8::op_2nnn() {
-    // put the current PC onto the top of the stack
-    stack[sp] = pc;
+void Chip8::op_2nnn(const Instruction &in) {
+    // put the current PC onto the top of the stack, which wraps around and
+    // overwrites the oldest return address when calls nest too deep
+    stack[sp % STACK_LEVELS] = pc;
     ++sp;
-    pc = nnn();
+    pc = in.nnn;
 }
 
 // Skip next instruction if Vx = kk
-void Chip8::op_3xkk() {
-    if (registers[Vx()] == kk()) {
-        pc += 2;
+void Chip8::op_3xkk(const Instruction &in) {
+    if (registers[in.x] == in.kk) {
+        pc += instruction_length(pc);
     }
 }
 
 // Skip next instruction if Vx != kk
-void Chip8::op_4xkk() {
-    if (registers[Vx()] != kk()) {
-        pc += 2;
+void Chip8::op_4xkk(const Instruction &in) {
+    if (registers[in.x] != in.kk) {
+        pc += instruction_length(pc);
     }
 }
 
 // Skip next instruction if Vx = Vy
-void Chip8::op_5xy0() {
-    if (registers[Vx()] == registers[Vy()]) {
-        pc += 2;
+void Chip8::op_5xy0(const Instruction &in) {
+    if (registers[in.x] == registers[in.y]) {
+        pc += instruction_length(pc);
     }
 }
 
 // Set Vx = kk
-void Chip8::op_6xkk() {
-    registers[Vx()] = kk();
+void Chip8::op_6xkk(const Instruction &in) {
+    registers[in.x] = in.kk;
 }
 
 // Set Vx = Vx + kk
-void Chip8::op_7xkk() {
-    registers[Vx()] += kk();
+void Chip8::op_7xkk(const Instruction &in) {
+    registers[in.x] += in.kk;
 }
 
 // Set Vx = Vy
-void Chip8::op_8xy0() {
-    registers[Vx()] = registers[Vy()];
+void Chip8::op_8xy0(const Instruction &in) {
+    registers[in.x] = registers[in.y];
 }
 
 // Set Vx = Vx OR Vy
-void Chip8::op_8xy1() {
-    registers[Vx()] |= registers[Vy()];
+template <Quirks Q>
+void Chip8::op_8xy1(const Instruction &in) {
+    registers[in.x] |= registers[in.y];
+    if constexpr (quirk_set(Q).vf_reset) {
+        registers[VF] = 0;
+    }
 }
 
 // Set Vx = Vx AND Vy
-void Chip8::op_8xy2() {
-    registers[Vx()] &= registers[Vy()];
+template <Quirks Q>
+void Chip8::op_8xy2(const Instruction &in) {
+    registers[in.x] &= registers[in.y];
+    if constexpr (quirk_set(Q).vf_reset) {
+        registers[VF] = 0;
+    }
 }
 
 // Set Vx = Vx XOR Vy
-void Chip8::op_8xy3() {
-    registers[Vx()] ^= registers[Vy()];
+template <Quirks Q>
+void Chip8::op_8xy3(const Instruction &in) {
+    registers[in.x] ^= registers[in.y];
+    if constexpr (quirk_set(Q).vf_reset) {
+        registers[VF] = 0;
+    }
 }
 
 // Set Vx = Vx + Vy, set VF = carry
 // The values of Vx and Vy are added together. If the result is greater than
 // 8 bits (i.e., > 255,), VF is set to 1, otherwise 0. Only the lowest 8 bits
 // of the result are kept, and stored in Vx.
-void Chip8::op_8xy4() {
-    uint8_t Vx = this->Vx();
-    uint8_t Vy = this->Vy();
+template <Quirks Q>
+void Chip8::op_8xy4(const Instruction &in) {
+    uint8_t Vx = in.x;
+    uint8_t Vy = in.y;
 
     uint16_t sum = registers[Vx] + registers[Vy];
-    registers[VF] = sum > 255 ? 1 : 0;
-    registers[Vx] = sum & 0xFFu;
+    if constexpr (quirk_set(Q).flag_last) {
+        registers[Vx] = sum & 0xFFu;
+        registers[VF] = sum > 255 ? 1 : 0;
+    } else {
+        registers[VF] = sum > 255 ? 1 : 0;
+        registers[Vx] = sum & 0xFFu;
+    }
 }
 
 // Set Vx = Vx - Vy, set VF = NOT borrow
 // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx,
 // and the results stored in Vx.
-void Chip8::op_8xy5() {
-    uint8_t Vx = this->Vx();
-    uint8_t Vy = this->Vy();
-    registers[VF] = registers[Vy] > registers[Vx] ? 0 : 1;
-    registers[Vx] -= registers[Vy];
+template <Quirks Q>
+void Chip8::op_8xy5(const Instruction &in) {
+    uint8_t Vx = in.x;
+    uint8_t Vy = in.y;
+    if constexpr (quirk_set(Q).flag_last) {
+        uint8_t flag = registers[Vy] > registers[Vx] ? 0 : 1;
+        registers[Vx] -= registers[Vy];
+        registers[VF] = flag;
+    } else {
+        registers[VF] = registers[Vy] > registers[Vx] ? 0 : 1;
+        registers[Vx] -= registers[Vy];
+    }
 }
 
 // Set Vx = Vx SHR 1
 // If the least-significant bit of Vx is 1, then VF is set to 1,
-// otherwise 0. Then Vx is divided by 2.
-void Chip8::op_8xy6() {
-    uint8_t Vx = this->Vx();
-
-    // Save least-significant bit (LSB) in VF
-    registers[VF] = (registers[Vx] & 0x1);
-
-    // divide by 2
-    registers[Vx] >>= 1;
+// otherwise 0. Then Vx is divided by 2. The VIP shifts Vy into Vx instead.
+//
+// 8xy4 to 8xyE write VF after Vx on everything but the legacy profile, so
+// that VF ends up holding the flag when x is F.
+template <Quirks Q>
+void Chip8::op_8xy6(const Instruction &in) {
+    uint8_t Vx = in.x;
+    uint8_t Vs = quirk_set(Q).shift_vy ? in.y : in.x;
+    if constexpr (quirk_set(Q).flag_last) {
+        uint8_t value = registers[Vs];
+        registers[Vx] = value >> 1;
+        registers[VF] = value & 0x1;
+    } else {
+        // Save least-significant bit (LSB) in VF
+        registers[VF] = (registers[Vs] & 0x1);
+
+        // divide by 2
+        registers[Vx] = registers[Vs] >> 1;
+    }
 }
 
 // Set Vx = Vy - Vx, set VF = NOT borrow
 // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is
 // subtracted from Vy, and the results stored in Vx.
-void Chip8::op_8xy7() {
-    uint8_t Vx = this->Vx();
-    uint8_t Vy = this->Vy();
-
-    registers[VF] = (registers[Vy] > registers[Vx] ? 1 : 0);
-    registers[Vx] = registers[Vy] - registers[Vx];
+template <Quirks Q>
+void Chip8::op_8xy7(const Instruction &in) {
+    uint8_t Vx = in.x;
+    uint8_t Vy = in.y;
+    if constexpr (quirk_set(Q).flag_last) {
+        uint8_t flag = registers[Vy] > registers[Vx] ? 1 : 0;
+        registers[Vx] = registers[Vy] - registers[Vx];
+        registers[VF] = flag;
+    } else {
+        registers[VF] = (registers[Vy] > registers[Vx] ? 1 : 0);
+        registers[Vx] = registers[Vy] - registers[Vx];
+    }
 }
 
 // Set Vx = Vx SHL 1
 // If the most-significant bit of Vx is 1, then VF is set to 1,
-// otherwise to 0. Then Vx is multiplied by 2.
-void Chip8::op_8xyE() {
-    uint8_t Vx = this->Vx();
-
-    // Save most-significant bit (MSB) in VF
-    registers[VF] = (registers[Vx] & 0x80) >> 7;
-
-    // multiply by 2
-    registers[Vx] <<= 1;
+// otherwise to 0. Then Vx is multiplied by 2. The VIP shifts Vy into Vx instead.
+template <Quirks Q>
+void Chip8::op_8xyE(const Instruction &in) {
+    uint8_t Vx = in.x;
+    uint8_t Vs = quirk_set(Q).shift_vy ? in.y : in.x;
+    if constexpr (quirk_set(Q).flag_last) {
+        uint8_t value = registers[Vs];
+        registers[Vx] = value << 1;
+        registers[VF] = (value & 0x80) >> 7;
+    } else {
+        // Save most-significant bit (MSB) in VF
+        registers[VF] = (registers[Vs] & 0x80) >> 7;
+
+        // multiply by 2
+        registers[Vx] = registers[Vs] << 1;
+    }
 }
 
 // Skip next instruction if Vx != Vy
-void Chip8::op_9xy0() {
-    if (registers[Vx()] != registers[Vy()]) {
-        pc += 2;
+void Chip8::op_9xy0(const Instruction &in) {
+    if (registers[in.x] != registers[in.y]) {
+        pc += instruction_length(pc);
     }
 }
 
 // Set I = nnn
-void Chip8::op_Annn() {
-    index = nnn();
+void Chip8::op_Annn(const Instruction &in) {
+    index = in.nnn;
 }
 
-// Jump to location nnn + V0
-void Chip8::op_Bnnn() {
-    pc = registers[0] + nnn();
+// Jump to location nnn + V0, or xnn + Vx on CHIP-48 and SUPER-CHIP
+template <Quirks Q>
+void Chip8::op_Bnnn(const Instruction &in) {
+    pc = registers[quirk_set(Q).jump_vx ? in.x : 0] + in.nnn;
 }
 
 // Set Vx = random byte AND kk
-void Chip8::op_Cxkk() {
-    registers[Vx()] = rand_byte(rand_gen) & kk();
+void Chip8::op_Cxkk(const Instruction &in) {
+    registers[in.x] = rand_gen.next_byte() & in.kk;
 }
 
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
-void Chip8::op_Dxyn() {
-    uint8_t x = registers[Vx()] % VIDEO_WIDTH;
-    uint8_t y = registers[Vy()] % VIDEO_HEIGHT;
-    uint8_t height = opcode & 0x000F;
-
-    registers[VF] = 0;
-    for (int row = 0; row < height; row++) {
-        uint8_t byte = memory[index + row];
-        for (int col = 0; col < 8; col++) {
-            uint8_t sprite_pixel = byte & (0x80 >> col);
-            uint32_t *screen_pixel = &video[(y + row) * VIDEO_WIDTH + (x + col)];
-            if (sprite_pixel != 0) {
-                // sprite pixel is on
-                if (*screen_pixel == 1) {
-                    // screen pixel is also on, we have a collision
-                    registers[VF] = 1;
-                }
-
-                *screen_pixel ^= 1;
-            }
-        }
-    }
+//
+// Every display row is made of 64-bit words, so each sprite row is drawn
+// with a shift and XOR per word, and it collides if it shares any bit with
+// the row. The start position wraps around the screen. The parts of the
+// sprite past the right or bottom edge are clipped, or wrap around as well
+// with the modern quirks. Dxy0 draws a 16x16 sprite, see Display::draw.
+template <Quirks Q>
+void Chip8::op_Dxyn(const Instruction &in) {
+    constexpr bool wrap = quirk_set(Q).wrap_sprites;
+    uint64_t dirty = 0;
+    bool collision = display.draw<wrap>(plane_mask, memory, index, registers[in.x], registers[in.y], in.n, dirty);
+    registers[VF] = collision ? 1 : 0;
+    mark_drawn(dirty);
 
     draw_flag = true;
 }
 
 // Skip next instruction if key with the value of Vx is pressed
-void Chip8::op_Ex9E() {
-    if (keypad[registers[Vx()]]) {
-        pc += 2;
+void Chip8::op_Ex9E(const Instruction &in) {
+    // there are no keys past F, so they're never pressed
+    if (registers[in.x] < KEY_COUNT && keypad[registers[in.x]]) {
+        pc += instruction_length(pc);
     }
 }
 
 // Skip next instruction if key with the value of Vx is not pressed
-void Chip8::op_ExA1() {
-    if (!keypad[registers[Vx()]]) {
-        pc += 2;
+void Chip8::op_ExA1(const Instruction &in) {
+    if (registers[in.x] >= KEY_COUNT || !keypad[registers[in.x]]) {
+        pc += instruction_length(pc);
     }
 }
 
 // Set Vx = delay timer value
-void Chip8::op_Fx07() {
-    registers[Vx()] = delay_timer;
+void Chip8::op_Fx07(const Instruction &in) {
+    registers[in.x] = delay_timer;
 }
 
 // Wait for a key press, store the value of the key in Vx
-void Chip8::op_Fx0A() {
-    uint8_t Vx = this->Vx();
+void Chip8::op_Fx0A(const Instruction &in) {
+    uint8_t Vx = in.x;
     for (unsigned int i = 0; i < 16; i++) {
         if (keypad[i] != 0) {
             // key is pressed, store the value of the key in Vx
@@ -499,25 +1868,25 @@ void Chip8::op_Fx0A() {
 }
 
 // Set delay timer = Vx
-void Chip8::op_Fx15() {
-    delay_timer = registers[Vx()];
+void Chip8::op_Fx15(const Instruction &in) {
+    delay_timer = registers[in.x];
 }
 
 // Set sound timer = Vx
-void Chip8::op_Fx18() {
-    sound_timer = registers[Vx()];
+void Chip8::op_Fx18(const Instruction &in) {
+    sound_timer = registers[in.x];
 }
 
 // Set I = I + Vx
-void Chip8::op_Fx1E() {
-    uint8_t Vx = this->Vx();
+void Chip8::op_Fx1E(const Instruction &in) {
+    uint8_t Vx = in.x;
     registers[0xF] = index + registers[Vx] > 0xFFF ? 1 : 0;
     index += registers[Vx];
 }
 
 // Set I = location of sprite for digit Vx
-void Chip8::op_Fx29() {
-    index = 5 * registers[Vx()];
+void Chip8::op_Fx29(const Instruction &in) {
+    index = 5 * registers[in.x];
 }
 
 // Store BCD representation of Vx in memory locations I, I+1, and I+2
@@ -525,36 +1894,150 @@ void Chip8::op_Fx29() {
 // The interpreter takes the decimal value of Vx, and places the hundreds
 // digit in memory at location in I, the tens digit at location I+1,
 // the ones digit at location I+2.
-void Chip8::op_Fx33() {
-    uint8_t value = registers[Vx()];
-    memory[index + 2] = value % 10; // Ones-place
+void Chip8::op_Fx33(const Instruction &in) {
+    uint8_t value = registers[in.x];
+    memory[static_cast<uint16_t>(index + 2)] = value % 10; // Ones-place
     value /= 10;
-    memory[index + 1] = value % 10; // Tens-place
+    memory[static_cast<uint16_t>(index + 1)] = value % 10; // Tens-place
     value /= 10;
     memory[index] = value % 10; // Hundreds-place
+
+    invalidate_blocks(index, 3);
 }
 
 // Store registers V0 through Vx in memory starting at location I
-void Chip8::op_Fx55() {
-    uint8_t Vx = this->Vx();
+template <Quirks Q>
+void Chip8::op_Fx55(const Instruction &in) {
+    uint8_t Vx = in.x;
     for (uint8_t i = 0; i <= Vx; ++i) {
-        memory[index + i] = registers[i];
+        memory[static_cast<uint16_t>(index + i)] = registers[i];
     }
-    index = Vx + 1;
+    invalidate_blocks(index, Vx + 1);
+    index = index_after_load_store(quirk_set(Q).load_store, index, Vx);
 }
 
 // Read registers V0 through Vx from memory starting at location I
-void Chip8::op_Fx65() {
-    uint8_t Vx = this->Vx();
+template <Quirks Q>
+void Chip8::op_Fx65(const Instruction &in) {
+    uint8_t Vx = in.x;
     for (uint8_t i = 0; i <= Vx; i++) {
-        registers[i] = memory[index + i];
+        registers[i] = memory[static_cast<uint16_t>(index + i)];
     }
-    index = Vx + 1;
+    index = index_after_load_store(quirk_set(Q).load_store, index, Vx);
+}
+
+// Scroll the display down n rows
+void Chip8::op_00Cn(const Instruction &in) {
+    mark_drawn(display.scroll_down(plane_mask, in.n));
+    draw_flag = true;
+}
+
+// Scroll the display right 4 pixels
+void Chip8::op_00FB(const Instruction &in) {
+    mark_drawn(display.scroll_right(plane_mask));
+    draw_flag = true;
+}
+
+// Scroll the display left 4 pixels
+void Chip8::op_00FC(const Instruction &in) {
+    mark_drawn(display.scroll_left(plane_mask));
+    draw_flag = true;
+}
+
+// Stop the program
+// The machine stays on this instruction from now on, so whatever is on the
+// display stays there.
+void Chip8::op_00FD(const Instruction &in) {
+    pc -= 2;
+}
+
+// Switch to the 64x32 display, clearing it
+void Chip8::op_00FE(const Instruction &in) {
+    mark_drawn(display.set_hires(false));
+    draw_flag = true;
+}
+
+// Switch to the 128x64 display, clearing it
+void Chip8::op_00FF(const Instruction &in) {
+    mark_drawn(display.set_hires(true));
+    draw_flag = true;
 }
 
-void Chip8::op_null() {
-    std::cerr << "Unknown opcode: " << std::hex << opcode << std::endl;
-    std::exit(EXIT_FAILURE);
+// Set I = location of large sprite for digit Vx
+void Chip8::op_Fx30(const Instruction &in) {
+    index = FONTSET_SIZE + 10 * (registers[in.x] & 0xFu);
+}
+
+// Store V0 through Vx in the user flags
+void Chip8::op_Fx75(const Instruction &in) {
+    for (uint8_t i = 0; i <= in.x; i++) {
+        user_flags[i] = registers[i];
+    }
+}
+
+// Read V0 through Vx from the user flags
+void Chip8::op_Fx85(const Instruction &in) {
+    for (uint8_t i = 0; i <= in.x; i++) {
+        registers[i] = user_flags[i];
+    }
+}
+
+// Scroll the display up n rows
+void Chip8::op_00Dn(const Instruction &in) {
+    mark_drawn(display.scroll_up(plane_mask, in.n));
+    draw_flag = true;
+}
+
+// Store registers Vx through Vy in memory starting at location I
+// The registers are stored in reverse order when x is greater than y. I is
+// left alone.
+void Chip8::op_5xy2(const Instruction &in) {
+    int step = in.x <= in.y ? 1 : -1;
+    unsigned int count = (in.x <= in.y ? in.y - in.x : in.x - in.y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        memory[static_cast<uint16_t>(index + i)] = registers[in.x + step * static_cast<int>(i)];
+    }
+    invalidate_blocks(index, count);
+}
+
+// Read registers Vx through Vy from memory starting at location I
+void Chip8::op_5xy3(const Instruction &in) {
+    int step = in.x <= in.y ? 1 : -1;
+    unsigned int count = (in.x <= in.y ? in.y - in.x : in.x - in.y) + 1;
+    for (unsigned int i = 0; i < count; i++) {
+        registers[in.x + step * static_cast<int>(i)] = memory[static_cast<uint16_t>(index + i)];
+    }
+}
+
+// Set I = NNNN
+// The address is the 16-bit word after the instruction, which is skipped.
+void Chip8::op_F000(const Instruction &in) {
+    index = memory[pc] << 8u | memory[static_cast<uint16_t>(pc + 1)];
+    pc += 2;
+}
+
+// Select the planes that Dxyn, 00E0 and the scrolls act on, bit p for plane p
+void Chip8::op_Fn01(const Instruction &in) {
+    plane_mask = in.x & ((1u << PLANE_COUNT) - 1);
+}
+
+// Load the 16-byte audio pattern from memory starting at location I
+void Chip8::op_F002(const Instruction &in) {
+    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+        audio_pattern[i] = memory[static_cast<uint16_t>(index + i)];
+    }
+}
+
+// Set the audio pattern's pitch = Vx
+void Chip8::op_Fx3A(const Instruction &in) {
+    pitch = registers[in.x];
+}
+
+// Stop at the unknown opcode, leaving it to whoever runs the machine to
+// report it. Other machines in the same process carry on.
+void Chip8::op_null(const Instruction &in) {
+    pc -= 2;
+    crash = true;
 }
 
 //endregion
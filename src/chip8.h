@@ -1,28 +1,286 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <random>
+#include <memory>
+#include <string>
+#include <vector>
+#include "display.h"
 
 const unsigned int KEY_COUNT = 16;
-const unsigned int MEMORY_SIZE = 4096;
+const unsigned int MEMORY_SIZE = 0x10000; // XO-CHIP's 64K, CHIP-8 programs only see the first 4K
 const unsigned int REGISTER_COUNT = 16;
 const unsigned int STACK_LEVELS = 16;
-const int VIDEO_HEIGHT = 32;
-const int VIDEO_WIDTH = 64;
+
+// Jumps and calls only reach the first 4K, so code is only translated into
+// blocks there; anything run above it goes through the interpreter
+const unsigned int CODE_SIZE = 0x1000;
+
+// SUPER-CHIP's persistent user flags (Fx75, Fx85), 16 of them as on XO-CHIP
+const unsigned int FLAG_COUNT = 16;
+
+// XO-CHIP's 1-bit audio pattern (F002) and the pitch it plays at (Fx3A)
+const unsigned int AUDIO_PATTERN_SIZE = 16;
+const uint8_t DEFAULT_PITCH = 64;
+
+// The Chip8’s memory from 0x000 to 0x1FF is reserved
+// so the ROM instructions must start at 0x200.
+const unsigned int START_ADDRESS = 0x200;
+
+// The largest ROM that fits in memory after START_ADDRESS
+const size_t MAX_ROM_SIZE = MEMORY_SIZE - START_ADDRESS;
+
+// There are 16 different (0-F) 5-byte fonts.
+const unsigned int FONTSET_SIZE = 80;
+extern uint8_t fontset[FONTSET_SIZE];
+
+// There are 16 large 10-byte fonts for high resolution, placed right after
+// the small ones
+const unsigned int BIGFONT_SIZE = 160;
+extern uint8_t bigfont[BIGFONT_SIZE];
+
+// Instruction handlers, in the order they appear in Chip8's handler table
+enum Op : uint8_t {
+    OP_NULL,
+    OP_00E0, OP_00EE, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_6xkk,
+    OP_7xkk, OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, OP_8xy5, OP_8xy6,
+    OP_8xy7, OP_8xyE, OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn, OP_Ex9E,
+    OP_ExA1, OP_Fx07, OP_Fx0A, OP_Fx15, OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx33,
+    OP_Fx55, OP_Fx65,
+    // SUPER-CHIP
+    OP_00Cn, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_Fx30, OP_Fx75,
+    OP_Fx85,
+    // XO-CHIP
+    OP_00Dn, OP_5xy2, OP_5xy3, OP_F000, OP_Fn01, OP_F002, OP_Fx3A,
+    OP_COUNT
+};
+
+// Name of each handler, e.g. "8xy4"
+extern const char *const op_names[OP_COUNT];
+
+// A decoded instruction: which handler to run and its operand fields
+struct Instruction {
+    uint8_t op;   // handler (Op)
+    uint8_t x;    // register index from 0x0X00
+    uint8_t y;    // register index from 0x00Y0
+    uint8_t n;    // 4-bit nibble from 0x000N
+    uint8_t kk;   // 8-bit byte from 0x00KK
+    uint16_t nnn; // 12-bit address from 0x0NNN
+};
+
+// Decode an opcode into its handler and operand fields
+Instruction decode(uint16_t opcode);
+
+// Assembly for an opcode, e.g. "ADD V3, V4", or "DW 0x...." for data
+std::string disassemble(uint16_t opcode);
+
+// Decoded instruction for every possible opcode
+extern const std::vector<Instruction> decode_table;
+
+// Whether a handler writes register x of its opcode (as the last of a range
+// for Fx65, Fx85 and 5xy3)
+bool writes_vx(uint8_t op);
+
+// Starting value for hash_bytes
+const uint64_t HASH_SEED = 0xcbf29ce484222325;
+
+// Mix bytes into a state hash (FNV-1a)
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size);
+
+// Random numbers for Cxkk (SplitMix64). The whole state is one word, so it
+// costs nothing to save, restore or copy, and a seed always gives the same
+// sequence on every platform and standard library.
+struct Random {
+    uint64_t state{};
+
+    void seed(uint64_t value) {
+        state = value;
+    }
+
+    uint8_t next_byte() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return static_cast<uint8_t>((z ^ (z >> 31)) >> 56);
+    }
+};
+
+// How Chip8 dispatches instructions
+enum class Core {
+    Switch, // decode and run every opcode in the original nested switch, apart from the handlers
+    Table,  // look the opcode up in a table predecoded for all 64K opcodes
+    Block,  // run cached straight-line blocks of predecoded instructions (Chip8::run only)
+    Jit     // like Block, but hot blocks are compiled to native code where supported,
+            // in runs of at least Chip8::jit_min_cycles
+};
+
+// Fewest instructions a call to Chip8::run needs to be given before the JIT
+// core compiles anything. Chained native code only pays for itself over
+// long runs: at the bench's 10 to 300 instructions per frame it's no faster
+// than the block core, and it only pulls ahead at around 1000.
+const unsigned int JIT_MIN_CYCLES = 1000;
+
+// Instruction sets that disagree on what some instructions do
+enum class Quirks : uint8_t {
+    Legacy, // what this emulator has always done, the default
+    Vip,    // the original COSMAC VIP interpreter
+    Chip48, // CHIP-48 on the HP-48
+    Schip,  // SUPER-CHIP 1.1
+    Modern  // what most current emulators and Octo do
+};
+
+// What Fx55 and Fx65 leave in I
+enum class LoadStore : uint8_t {
+    Legacy,     // I = x + 1
+    Increment,  // I = I + x + 1
+    IncrementX, // I = I + x
+    Unchanged   // I is left alone
+};
+
+// How a profile resolves each of the ambiguous instructions
+struct QuirkSet {
+    bool vf_reset;        // 8xy1, 8xy2 and 8xy3 clear VF
+    bool shift_vy;        // 8xy6 and 8xyE shift Vy into Vx instead of shifting Vx
+    bool jump_vx;         // Bxnn jumps to xnn + Vx instead of nnn + V0
+    bool wrap_sprites;    // Dxyn wraps sprites around the edges instead of clipping them
+    bool flag_last;       // 8xy4 to 8xyE set VF after Vx, so the flag wins when x is F
+    LoadStore load_store;
+};
+
+// Indexed by Quirks
+constexpr QuirkSet quirk_sets[] = {
+        {false, false, false, false, false, LoadStore::Legacy},
+        {true,  true,  false, false, true,  LoadStore::Increment},
+        {false, false, true,  false, true,  LoadStore::IncrementX},
+        {false, false, true,  false, true,  LoadStore::Unchanged},
+        {false, true,  false, true,  true,  LoadStore::Increment},
+};
+
+constexpr const QuirkSet &quirk_set(Quirks quirks) {
+    return quirk_sets[static_cast<uint8_t>(quirks)];
+}
+
+// What Fx55 and Fx65 leave in I after storing or loading V0 through Vx
+constexpr uint16_t index_after_load_store(LoadStore load_store, uint16_t index, uint8_t x) {
+    switch (load_store) {
+        case LoadStore::Legacy:
+            return x + 1;
+        case LoadStore::Increment:
+            return index + x + 1;
+        case LoadStore::IncrementX:
+            return index + x;
+        default:
+            return index;
+    }
+}
+
+// Look up a profile by name ("legacy", "vip", "chip48", "schip" or "modern")
+bool parse_quirks(const std::string &name, Quirks &quirks);
+const char *quirks_name(Quirks quirks);
+
+class Jit;
+class Chip8;
+class Profiler;
+class Tracer;
+struct Snapshot;
+
+// Native code compiled for a block, which carries on into the blocks after
+// it as long as they're compiled and the cycle budget lasts
+typedef void (*JitCode)(Chip8 *);
+
+// The delay and sound timers count down at 60 Hz, once per frame
+const unsigned int FRAMES_PER_SECOND = 60;
+
+// Instructions executed per frame unless told otherwise (600 Hz)
+const unsigned int DEFAULT_CYCLES_PER_FRAME = 10;
+
+// Longest run of instructions translated into a single block
+const unsigned int MAX_BLOCK_LENGTH = 64;
+
+// Writes to memory are tracked in pages of this size, so that reset() and
+// copy_from() only copy the pages a machine has written
+const unsigned int MEMORY_PAGE_SIZE = 256;
+const unsigned int MEMORY_PAGES = MEMORY_SIZE / MEMORY_PAGE_SIZE;
 
 class Chip8 {
 public:
     Chip8();
+    ~Chip8();
 
     bool load_rom(char const *filename);
+    bool load_rom(const uint8_t *data, size_t size);
+    void seed(uint64_t value);
     void cycle();
+    void run(unsigned int cycles);
+    void run_frame(unsigned int cycles);
+    void tick_timers();
+    uint64_t hash() const;
+    void save(Snapshot &snapshot) const;
+    void restore(const Snapshot &snapshot);
+
+    // Go back to the state right after the last load_rom, keeping the quirks,
+    // the core and everything translated from code that hasn't been written
+    // over. The random number generator goes back too, so seed() again after.
+    void reset();
+
+    // Make this machine a copy of another one, e.g. to fork many machines
+    // from a common state. Machines that loaded the same ROM image share it,
+    // and only the pages either of them has written since are copied.
+    void copy_from(const Chip8 &source);
+
+    // Hash of everything that decides what the machine does from here on,
+    // i.e. what hash() covers plus the keypad and the random number
+    // generator. It's kept up to date as the machine runs: only the memory
+    // pages and display rows written since the last call are hashed again.
+    uint64_t state_hash();
 
-    bool draw_flag;
-    uint32_t video[VIDEO_WIDTH * VIDEO_HEIGHT]{}; // 64x32 monochrome display memory
+    // Whether the machine is in exactly the state of a snapshot
+    bool matches(const Snapshot &snapshot) const;
+
+    // Pick the instruction set, see Quirks
+    void set_quirks(Quirks quirks);
+    Quirks quirks() const;
+
+    // The sound: on while the sound timer runs, playing XO-CHIP's pattern at
+    // its pitch, see src/audio.h
+    bool sound_on() const {
+        return sound_timer > 0;
+    }
+    const uint8_t *sound_pattern() const {
+        return audio_pattern;
+    }
+    uint8_t sound_pitch() const {
+        return pitch;
+    }
+
+    // Whether the machine ran into an opcode it doesn't know. It stops there,
+    // with pc at the opcode, and runs nothing and counts no timers down
+    // until it's reset, restored or copied over.
+    bool crashed() const {
+        return crash;
+    }
+
+    // The opcode at pc, i.e. what cycle() runs next, and where it is
+    uint16_t next_opcode() const {
+        return memory[pc] << 8 | memory[static_cast<uint16_t>(pc + 1)];
+    }
+    uint16_t next_address() const {
+        return pc;
+    }
+
+    Core core = Core::Table;
+    unsigned int jit_min_cycles = JIT_MIN_CYCLES; // see JIT_MIN_CYCLES
+    bool draw_flag{};
+    uint64_t dirty_rows{}; // bit y is set when display row y has changed, cleared by the frontend
+    Display display;       // 64x32 or 128x64, one or two planes
     uint8_t keypad[KEY_COUNT]{}; // 16 input keys 0-F
+    Tracer *tracer{};            // records every instruction executed while set
+#ifdef CHIP8_PROFILE
+    Profiler *profiler{}; // counts everything executed while set
+#endif
 private:
     uint8_t registers[REGISTER_COUNT]{}; // 16 8-bit registers
-    uint8_t memory[MEMORY_SIZE]{};       // 4K bytes of memory
+    uint8_t memory[MEMORY_SIZE]{};       // 64K bytes of memory, for XO-CHIP
     uint16_t index{};                    // 16-bit index register
     uint16_t pc{};                       // 16-bit program counter
     uint16_t stack[STACK_LEVELS]{};      // 16-level stack (can hold 16 program counters)
@@ -30,51 +288,149 @@ private:
     uint8_t delay_timer{};               // 8-bit delay timer
     uint8_t sound_timer{};               // 8-bit sound timer
     uint16_t opcode;                     // 16-bit current instruction
+    uint8_t plane_mask = 1;              // planes drawn on, bit p for plane p
+    uint8_t user_flags[FLAG_COUNT]{};
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE]{};
+    uint8_t pitch = DEFAULT_PITCH;
+    bool crash{};                        // stopped at an unknown opcode, see crashed()
+
+    Random rand_gen;
+
+    // The state right after load_rom, shared with copies of this machine, and
+    // the pages of memory written since, bit p for page p. Every other page
+    // is the same as in the image.
+    std::shared_ptr<const Snapshot> image;
+    uint64_t written[MEMORY_PAGES / 64]{};
+    void mark_written(unsigned int address, unsigned int length);
 
-    std::default_random_engine rand_gen;
-    std::uniform_int_distribution<uint8_t> rand_byte;
+    // Hashes of each memory page and display row as of the last
+    // state_hash(), combined with XOR, and the pages and rows changed since
+    uint64_t page_hashes[MEMORY_PAGES]{};
+    uint64_t row_hashes[HIRES_HEIGHT]{};
+    uint64_t memory_hash{};
+    uint64_t display_hash{};
+    uint64_t stale_pages[MEMORY_PAGES / 64]{};
+    uint64_t stale_rows = ~0ull;
+
+    void mark_drawn(uint64_t rows) {
+        dirty_rows |= rows;
+        stale_rows |= rows;
+    }
+    void copy_pages(const uint8_t *from, const uint64_t *pages);
+    void restore_registers(const Snapshot &snapshot);
+
+    // How many of the next instructions can be skipped because the machine
+    // is idle at pc, see run()
+    unsigned int idle_cycles(unsigned int cycles);
+
+    // Skips step over both halves of XO-CHIP's four byte F000 NNNN
+    uint16_t instruction_length(uint16_t address) const {
+        return memory[address] == 0xF0 && memory[static_cast<uint16_t>(address + 1)] == 0x00 ? 4 : 2;
+    }
+
+    //region Block cache
+
+    // A straight-line run of instructions ending at the first jump, call,
+    // return or Fx0A, translated once and replayed until invalidated. Skips
+    // are part of the run: one that's taken steps over the op after it.
+    struct Block {
+        std::vector<Instruction> ops;
+        uint16_t end{};   // address just past the last byte the block depends on
+        bool valid{};
+        bool may_idle{};         // starts like one of the loops idle_cycles() skips
+        JitCode jit{};           // native code for the whole block
+        uint8_t hits{};          // times run before being compiled
+    };
+
+    std::vector<Block> blocks;     // translated blocks, indexed by start address
+    std::vector<uint8_t> code_map; // number of valid blocks covering each byte of memory
+
+    Block *find_block(uint16_t address);
+    void invalidate_blocks(unsigned int address, unsigned int length);
+    void flush_blocks();
+
+    std::unique_ptr<Jit> jit;
+    uint32_t jit_budget{}; // cycles left for the native code, which it counts down
+    void compile_block(Block &block, uint16_t address);
+
+    friend class Jit;
+
+    //endregion
 
     //region Instructions
 
-    uint8_t Vx();   // get Vx
-    uint8_t Vy();   // get Vy
-    uint8_t kk();   // get kk
-    uint16_t nnn(); // get nnn
-    void op_00E0(); // CLS - clears the display
-    void op_00EE(); // RET - return from a subroutine
-    void op_1nnn(); // JP addr - jump to location nnn
-    void op_2nnn(); // CALL addr - call subroutine at nnn
-    void op_3xkk(); // SE Vx, byte - skip next instruction if Vx = kk
-    void op_4xkk(); // SNE Vx, byte - skip next instruction if Vx != kk
-    void op_5xy0(); // SE Vx, Vy - skip next instruction if Vx = Vy
-    void op_6xkk(); // LB Vx, byte - set Vx = kk
-    void op_7xkk(); // ADD Vx, byte - set Vx = Vx + kk
-    void op_8xy0(); // LD Vx, Vy - set Vx = Vy
-    void op_8xy1(); // OR Vx, Vy - set Vx = Vx OR Vy
-    void op_8xy2(); // AND Vx, Vy - set Vx = Vx AND Vy
-    void op_8xy3(); // XOR Vx, Vy - set Vx = Vx XOR Vy
-    void op_8xy4(); // ADD Vx, Vy - set Vx = Vx + Vy, set VF = carry
-    void op_8xy5(); // SUB Vx, Vy - set Vx = Vx - Vy, set VF = NOT borrow
-    void op_8xy6(); // SHR Vx - set Vx = Vx SHR 1
-    void op_8xy7(); // SUBN Vx, Vy - set Vx = Vy - Vx, set VF = NOT borrow
-    void op_8xyE(); // SHL Vx {, Vy} - set Vx = Vx SHL 1
-    void op_9xy0(); // SNE Vx, Vy - skip next instruction if Vx != Vy
-    void op_Annn(); // LD I, addr - set I = nnn
-    void op_Bnnn(); // JP V0, addr - jump to location nnn + V0
-    void op_Cxkk(); // RND Vx, byte - set Vx = random byte AND kk
-    void op_Dxyn(); // DRW Vx, Vy, nibble - display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
-    void op_Ex9E(); // SKP Vx - skip next instruction if key with the value of Vx is pressed
-    void op_ExA1(); // SKNP Vx - skip next instruction if key with the value of Vx is not pressed
-    void op_Fx07(); // LD Vx, DT - set Vx = delay timer value
-    void op_Fx0A(); // LD Vx, k - wait for a key press, store the value of the key in Vx
-    void op_Fx15(); // LD DT, Vx - set delay timer = Vx
-    void op_Fx18(); // LD ST, Vx - set sound timer = Vx
-    void op_Fx1E(); // ADD I, Vx - set I = I + Vx
-    void op_Fx29(); // LD F, Vx - set I = location of sprite for digit Vx
-    void op_Fx33(); // LD B, Vx - store BCD representation of Vx in memory locations I, I+1, and I+2
-    void op_Fx55(); // LD [I], Vx - store registers V0 through Vx in memory starting at location I
-    void op_Fx65(); // LD Vx, [I] - read registers V0 through Vx from memory starting at location I
-    void op_null(); // does nothing
+    // One handler table per instruction set, the handlers that differ are
+    // compiled separately for each so they don't check the quirks as they run
+    typedef void (Chip8::*Handler)(const Instruction &);
+    template <Quirks Q>
+    static const Handler handler_table[OP_COUNT];
+    const Handler *handlers = handler_table<Quirks::Legacy>;
+    Quirks quirk_profile = Quirks::Legacy;
+
+    void execute(const Instruction &in);
+
+    // The original interpreter, Core::Switch: decodes the opcode through a
+    // nested switch and runs it right there, without the handlers below, so
+    // it can tell when they or the cores built on them go wrong
+    void interpret();
+    uint8_t Vx() const;   // get Vx
+    uint8_t Vy() const;   // get Vy
+    uint8_t kk() const;   // get kk
+    uint16_t nnn() const; // get nnn
+    bool draw_pixels(uint8_t x, uint8_t y, uint8_t n);
+    void scroll_pixels(int dx, int dy);
+
+    void op_00E0(const Instruction &in); // CLS - clears the display
+    void op_00EE(const Instruction &in); // RET - return from a subroutine
+    void op_1nnn(const Instruction &in); // JP addr - jump to location nnn
+    void op_2nnn(const Instruction &in); // CALL addr - call subroutine at nnn
+    void op_3xkk(const Instruction &in); // SE Vx, byte - skip next instruction if Vx = kk
+    void op_4xkk(const Instruction &in); // SNE Vx, byte - skip next instruction if Vx != kk
+    void op_5xy0(const Instruction &in); // SE Vx, Vy - skip next instruction if Vx = Vy
+    void op_6xkk(const Instruction &in); // LB Vx, byte - set Vx = kk
+    void op_7xkk(const Instruction &in); // ADD Vx, byte - set Vx = Vx + kk
+    void op_8xy0(const Instruction &in); // LD Vx, Vy - set Vx = Vy
+    template <Quirks Q> void op_8xy1(const Instruction &in); // OR Vx, Vy - set Vx = Vx OR Vy
+    template <Quirks Q> void op_8xy2(const Instruction &in); // AND Vx, Vy - set Vx = Vx AND Vy
+    template <Quirks Q> void op_8xy3(const Instruction &in); // XOR Vx, Vy - set Vx = Vx XOR Vy
+    template <Quirks Q> void op_8xy4(const Instruction &in); // ADD Vx, Vy - set Vx = Vx + Vy, set VF = carry
+    template <Quirks Q> void op_8xy5(const Instruction &in); // SUB Vx, Vy - set Vx = Vx - Vy, set VF = NOT borrow
+    template <Quirks Q> void op_8xy6(const Instruction &in); // SHR Vx - set Vx = Vx SHR 1
+    template <Quirks Q> void op_8xy7(const Instruction &in); // SUBN Vx, Vy - set Vx = Vy - Vx, set VF = NOT borrow
+    template <Quirks Q> void op_8xyE(const Instruction &in); // SHL Vx {, Vy} - set Vx = Vx SHL 1
+    void op_9xy0(const Instruction &in); // SNE Vx, Vy - skip next instruction if Vx != Vy
+    void op_Annn(const Instruction &in); // LD I, addr - set I = nnn
+    template <Quirks Q> void op_Bnnn(const Instruction &in); // JP V0, addr - jump to location nnn + V0
+    void op_Cxkk(const Instruction &in); // RND Vx, byte - set Vx = random byte AND kk
+    template <Quirks Q> void op_Dxyn(const Instruction &in); // DRW Vx, Vy, nibble - display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
+    void op_Ex9E(const Instruction &in); // SKP Vx - skip next instruction if key with the value of Vx is pressed
+    void op_ExA1(const Instruction &in); // SKNP Vx - skip next instruction if key with the value of Vx is not pressed
+    void op_Fx07(const Instruction &in); // LD Vx, DT - set Vx = delay timer value
+    void op_Fx0A(const Instruction &in); // LD Vx, k - wait for a key press, store the value of the key in Vx
+    void op_Fx15(const Instruction &in); // LD DT, Vx - set delay timer = Vx
+    void op_Fx18(const Instruction &in); // LD ST, Vx - set sound timer = Vx
+    void op_Fx1E(const Instruction &in); // ADD I, Vx - set I = I + Vx
+    void op_Fx29(const Instruction &in); // LD F, Vx - set I = location of sprite for digit Vx
+    void op_Fx33(const Instruction &in); // LD B, Vx - store BCD representation of Vx in memory locations I, I+1, and I+2
+    template <Quirks Q> void op_Fx55(const Instruction &in); // LD [I], Vx - store registers V0 through Vx in memory starting at location I
+    template <Quirks Q> void op_Fx65(const Instruction &in); // LD Vx, [I] - read registers V0 through Vx from memory starting at location I
+    void op_00Cn(const Instruction &in); // SCD nibble - scroll the display down n rows
+    void op_00FB(const Instruction &in); // SCR - scroll the display right 4 pixels
+    void op_00FC(const Instruction &in); // SCL - scroll the display left 4 pixels
+    void op_00FD(const Instruction &in); // EXIT - stop the program
+    void op_00FE(const Instruction &in); // LOW - switch to low resolution
+    void op_00FF(const Instruction &in); // HIGH - switch to high resolution
+    void op_Fx30(const Instruction &in); // LD HF, Vx - set I = location of large sprite for digit Vx
+    void op_Fx75(const Instruction &in); // LD R, Vx - store V0 through Vx in the user flags
+    void op_Fx85(const Instruction &in); // LD Vx, R - read V0 through Vx from the user flags
+    void op_00Dn(const Instruction &in); // SCU nibble - scroll the display up n rows
+    void op_5xy2(const Instruction &in); // LD [I], Vx-Vy - store registers Vx through Vy in memory starting at location I
+    void op_5xy3(const Instruction &in); // LD Vx-Vy, [I] - read registers Vx through Vy from memory starting at location I
+    void op_F000(const Instruction &in); // LD I, long - set I = the 16-bit address that follows
+    void op_Fn01(const Instruction &in); // PLANE n - select the planes to draw on
+    void op_F002(const Instruction &in); // AUDIO - load the audio pattern from memory starting at location I
+    void op_Fx3A(const Instruction &in); // PITCH Vx - set the audio pattern's pitch = Vx
+    void op_null(const Instruction &in); // stops the machine, see crashed()
 
     //endregion
 };
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "display.h"
+#include <cstring>
+
+uint64_t Display::clear(uint8_t mask) {
+    // only rows that had something on them actually change
+    uint64_t dirty = 0;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if ((mask >> plane) & 1u) {
+            for (int y = 0; y < HIRES_HEIGHT; y++) {
+                dirty |= (planes[plane][y][0] | planes[plane][y][1]) != 0 ? 1ull << y : 0;
+            }
+            memset(planes[plane], 0, sizeof(planes[plane]));
+        }
+    }
+    return dirty;
+}
+
+uint64_t Display::set_hires(bool on) {
+    hires = on;
+    memset(planes, 0, sizeof(planes));
+    return ~0ull;
+}
+
+uint64_t Display::scroll_down(uint8_t mask, unsigned int rows) {
+    unsigned int height = this->height();
+    rows = rows < height ? rows : height;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if ((mask >> plane) & 1u) {
+            memmove(planes[plane][rows], planes[plane][0], (height - rows) * sizeof(planes[plane][0]));
+            memset(planes[plane][0], 0, rows * sizeof(planes[plane][0]));
+        }
+    }
+    return mask != 0 ? all_rows() : 0;
+}
+
+uint64_t Display::scroll_up(uint8_t mask, unsigned int rows) {
+    unsigned int height = this->height();
+    rows = rows < height ? rows : height;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if ((mask >> plane) & 1u) {
+            memmove(planes[plane][0], planes[plane][rows], (height - rows) * sizeof(planes[plane][0]));
+            memset(planes[plane][height - rows], 0, rows * sizeof(planes[plane][0]));
+        }
+    }
+    return mask != 0 ? all_rows() : 0;
+}
+
+uint64_t Display::scroll_right(uint8_t mask) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if ((mask >> plane) & 1u) {
+            for (int y = 0; y < height(); y++) {
+                uint64_t *row = planes[plane][y];
+                if (hires) {
+                    row[1] = row[1] >> 4u | row[0] << 60u;
+                }
+                row[0] >>= 4u;
+            }
+        }
+    }
+    return mask != 0 ? all_rows() : 0;
+}
+
+uint64_t Display::scroll_left(uint8_t mask) {
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if ((mask >> plane) & 1u) {
+            for (int y = 0; y < height(); y++) {
+                uint64_t *row = planes[plane][y];
+                if (hires) {
+                    row[0] = row[0] << 4u | row[1] >> 60u;
+                    row[1] <<= 4u;
+                } else {
+                    row[0] <<= 4u;
+                }
+            }
+        }
+    }
+    return mask != 0 ? all_rows() : 0;
+}
+
+// Place a left-aligned sprite row at column x of a row of `words` words,
+// clipping or wrapping at the right edge
+static void place(uint64_t bits, unsigned int x, unsigned int words, bool wrap, uint64_t out[ROW_WORDS]) {
+    if (words == 1) {
+        out[0] = !wrap || x == 0 ? bits >> x : bits >> x | bits << (64 - x);
+        return;
+    }
+    if (x < 64) {
+        // a sprite is at most 16 pixels wide, so it can't reach past the second word
+        out[0] = bits >> x;
+        out[1] = x == 0 ? 0 : bits << (64 - x);
+    } else {
+        out[0] = wrap && x > 64 ? bits << (128 - x) : 0;
+        out[1] = bits >> (x - 64);
+    }
+}
+
+bool Display::draw_sprite(uint8_t mask, const uint8_t *memory, uint16_t address, uint8_t x, uint8_t y,
+                          uint8_t n, bool wrap, uint64_t &dirty) {
+    unsigned int width = this->width();
+    unsigned int height = this->height();
+    unsigned int words = hires ? ROW_WORDS : 1;
+    unsigned int left = x % width;
+    unsigned int top = y % height;
+    bool wide = n == 0;
+    unsigned int rows = wide ? 16 : n;
+
+    bool collision = false;
+    uint16_t source = address;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (((mask >> plane) & 1u) == 0) {
+            continue;
+        }
+        for (unsigned int row = 0; row < rows; row++) {
+            uint64_t bits;
+            if (wide) {
+                bits = (uint64_t) (memory[source] << 8u | memory[static_cast<uint16_t>(source + 1)]) << 48u;
+                source += 2;
+            } else {
+                bits = (uint64_t) memory[source] << 56u;
+                source += 1;
+            }
+
+            // rows past the bottom still use up their sprite data
+            unsigned int line = top + row;
+            if (line >= height) {
+                if (!wrap) {
+                    continue;
+                }
+                line -= height;
+            }
+
+            uint64_t sprite[ROW_WORDS]{};
+            place(bits, left, words, wrap, sprite);
+            uint64_t *target = planes[plane][line];
+            uint64_t hit = 0;
+            uint64_t drawn = 0;
+            for (unsigned int word = 0; word < words; word++) {
+                hit |= target[word] & sprite[word];
+                target[word] ^= sprite[word];
+                drawn |= sprite[word];
+            }
+            collision |= hit != 0;
+            dirty |= (drawn != 0 ? 1ull : 0ull) << line;
+        }
+    }
+    return collision;
+}
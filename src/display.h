@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+
+// The CHIP-8 display, and SUPER-CHIP's and XO-CHIP's low resolution mode
+const int VIDEO_WIDTH = 64;
+const int VIDEO_HEIGHT = 32;
+
+// SUPER-CHIP's and XO-CHIP's high resolution mode
+const int HIRES_WIDTH = 128;
+const int HIRES_HEIGHT = 64;
+
+// XO-CHIP draws on two bitplanes, which gives four colors
+const unsigned int PLANE_COUNT = 2;
+
+// 64-bit words in a high resolution row
+const unsigned int ROW_WORDS = HIRES_WIDTH / 64;
+
+// Place a sprite byte at column x of a display row, clipping whatever falls
+// off the right edge
+inline uint64_t sprite_row(uint8_t byte, unsigned int x) {
+    const unsigned int last = VIDEO_WIDTH - 8;
+    if (x <= last) {
+        return (uint64_t) byte << (last - x);
+    }
+    return (uint64_t) byte >> (x - last);
+}
+
+// Place a sprite byte at column x of a display row, wrapping what falls off
+// the right edge around to the left
+inline uint64_t sprite_row_wrapped(uint8_t byte, unsigned int x) {
+    uint64_t row = (uint64_t) byte << (VIDEO_WIDTH - 8);
+    x %= VIDEO_WIDTH;
+    return x == 0 ? row : row >> x | row << (VIDEO_WIDTH - x);
+}
+
+// Monochrome bitplanes made of rows of 64-bit words, leftmost pixel in the
+// top bit of a row's first word. At low resolution only the first word of
+// the first 32 rows is used, so a CHIP-8 sprite row is still drawn with one
+// shift and XOR. Scrolling moves whole rows or shifts words across a row,
+// nothing is done a pixel at a time.
+//
+// The operations that change it return the rows they changed, bit y for row y.
+struct Display {
+    uint64_t planes[PLANE_COUNT][HIRES_HEIGHT][ROW_WORDS]{};
+    bool hires{};
+
+    int width() const {
+        return hires ? HIRES_WIDTH : VIDEO_WIDTH;
+    }
+
+    int height() const {
+        return hires ? HIRES_HEIGHT : VIDEO_HEIGHT;
+    }
+
+    // Every row of the current resolution
+    uint64_t all_rows() const {
+        return hires ? ~0ull : (1ull << VIDEO_HEIGHT) - 1;
+    }
+
+    // Clear the planes selected by mask, bit p for plane p
+    uint64_t clear(uint8_t mask);
+
+    // Change resolution, which clears every plane
+    uint64_t set_hires(bool on);
+
+    uint64_t scroll_down(uint8_t mask, unsigned int rows);
+    uint64_t scroll_up(uint8_t mask, unsigned int rows);
+    uint64_t scroll_right(uint8_t mask); // by 4 pixels
+    uint64_t scroll_left(uint8_t mask);  // by 4 pixels
+
+    // XOR a sprite from memory onto the selected planes at (x, y), the
+    // position wrapping around the screen. It's n rows of 8 pixels, or 16
+    // rows of 16 pixels when n is 0, and each plane takes the next sprite's
+    // worth of bytes. What's past the right or bottom edge is clipped, or
+    // wraps around with Wrap. Returns true if any pixel was turned off.
+    template <bool Wrap>
+    bool draw(uint8_t mask, const uint8_t *memory, uint16_t address, uint8_t x, uint8_t y, uint8_t n,
+              uint64_t &dirty) {
+        if (hires || mask != 1 || n == 0) {
+            return draw_sprite(mask, memory, address, x, y, n, Wrap, dirty);
+        }
+
+        // a CHIP-8 sprite on the first plane, one word per row
+        x %= VIDEO_WIDTH;
+        y %= VIDEO_HEIGHT;
+        uint8_t height = n;
+        if (!Wrap && y + height > VIDEO_HEIGHT) {
+            height = VIDEO_HEIGHT - y;
+        }
+
+        uint64_t collision = 0;
+        uint64_t changed = 0;
+        for (int row = 0; row < height; row++) {
+            uint8_t byte = memory[static_cast<uint16_t>(address + row)];
+            uint64_t sprite = Wrap ? sprite_row_wrapped(byte, x) : sprite_row(byte, x);
+            unsigned int line = Wrap ? (y + row) % VIDEO_HEIGHT : y + row;
+            collision |= planes[0][line][0] & sprite;
+            planes[0][line][0] ^= sprite;
+            changed |= (sprite != 0 ? 1ull : 0ull) << line;
+        }
+        dirty |= changed;
+        return collision != 0;
+    }
+
+private:
+    // Every other kind of sprite: high resolution, 16x16 or several planes
+    bool draw_sprite(uint8_t mask, const uint8_t *memory, uint16_t address, uint8_t x, uint8_t y,
+                     uint8_t n, bool wrap, uint64_t &dirty);
+};
@@ -0,0 +1,405 @@
+#include "fuzz.h"
+#include "lockstep.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+namespace {
+
+struct Engine {
+    char const *name;
+    Core core;
+};
+
+// Chip8::run() on every core, against Chip8::cycle() stepped one at a time
+// on the switch core, whose nested switch doesn't share the other cores'
+// decoder or handlers
+const Engine engines[] = {
+        {"switch", Core::Switch},
+        {"table",  Core::Table},
+        {"block",  Core::Block},
+        {"jit",    Core::Jit},
+};
+const unsigned int ENGINE_COUNT = sizeof(engines) / sizeof(engines[0]);
+
+// Mixed into the seed for the keypad and chunk sizes, so they don't follow
+// the same sequence as Cxkk
+const uint64_t SCHEDULE_SEED = 0x5851F42D4C957F2D;
+
+// 8xy0 with x = y does nothing, it's what minimize() blanks instructions with
+const uint8_t NOP[2] = {0x80, 0x00};
+
+// A random number below n, for n up to 2^24
+unsigned int below(Random &random, unsigned int n) {
+    unsigned int value = random.next_byte() << 16u | random.next_byte() << 8u | random.next_byte();
+    return value % n;
+}
+
+// The first thing that differs between two states
+std::string difference(const Snapshot &expected, const Snapshot &actual) {
+    char text[80];
+    auto differs = [&text](const char *what, unsigned int should, unsigned int is) {
+        snprintf(text, sizeof(text), "%s is 0x%X, should be 0x%X", what, is, should);
+        return std::string(text);
+    };
+    char name[32];
+
+    if (expected.crashed != actual.crashed) {
+        return actual.crashed ? "stopped at an unknown opcode, shouldn't have" : "should have stopped at an unknown opcode";
+    }
+    if (expected.pc != actual.pc) {
+        return differs("pc", expected.pc, actual.pc);
+    }
+    for (unsigned int i = 0; i < REGISTER_COUNT; i++) {
+        if (expected.registers[i] != actual.registers[i]) {
+            snprintf(name, sizeof(name), "V%X", i);
+            return differs(name, expected.registers[i], actual.registers[i]);
+        }
+    }
+    if (expected.index != actual.index) {
+        return differs("I", expected.index, actual.index);
+    }
+    if (expected.sp != actual.sp) {
+        return differs("sp", expected.sp, actual.sp);
+    }
+    for (unsigned int i = 0; i < STACK_LEVELS; i++) {
+        if (expected.stack[i] != actual.stack[i]) {
+            snprintf(name, sizeof(name), "stack[%u]", i);
+            return differs(name, expected.stack[i], actual.stack[i]);
+        }
+    }
+    if (expected.delay_timer != actual.delay_timer) {
+        return differs("delay timer", expected.delay_timer, actual.delay_timer);
+    }
+    if (expected.sound_timer != actual.sound_timer) {
+        return differs("sound timer", expected.sound_timer, actual.sound_timer);
+    }
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        if (expected.memory[address] != actual.memory[address]) {
+            snprintf(name, sizeof(name), "memory[0x%04X]", address);
+            return differs(name, expected.memory[address], actual.memory[address]);
+        }
+    }
+    if (expected.display.hires != actual.display.hires) {
+        return differs("hires", expected.display.hires, actual.display.hires);
+    }
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        for (unsigned int y = 0; y < HIRES_HEIGHT; y++) {
+            if (memcmp(expected.display.planes[plane][y], actual.display.planes[plane][y],
+                       sizeof(expected.display.planes[plane][y])) != 0) {
+                snprintf(text, sizeof(text), "display row %u of plane %u differs", y, plane);
+                return text;
+            }
+        }
+    }
+    if (expected.plane_mask != actual.plane_mask) {
+        return differs("plane mask", expected.plane_mask, actual.plane_mask);
+    }
+    for (unsigned int i = 0; i < FLAG_COUNT; i++) {
+        if (expected.user_flags[i] != actual.user_flags[i]) {
+            snprintf(name, sizeof(name), "user flag %u", i);
+            return differs(name, expected.user_flags[i], actual.user_flags[i]);
+        }
+    }
+    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+        if (expected.audio_pattern[i] != actual.audio_pattern[i]) {
+            snprintf(name, sizeof(name), "audio pattern byte %u", i);
+            return differs(name, expected.audio_pattern[i], actual.audio_pattern[i]);
+        }
+    }
+    if (expected.pitch != actual.pitch) {
+        return differs("pitch", expected.pitch, actual.pitch);
+    }
+    if (expected.rand_gen.state != actual.rand_gen.state) {
+        return "random number generator differs";
+    }
+    return "state hash differs";
+}
+
+// Every opcode that decodes to each handler, so random instructions can
+// pick the handler first: otherwise 00E0 would come up once in 64K
+const std::vector<std::vector<uint16_t>> &opcodes_by_op() {
+    static const std::vector<std::vector<uint16_t>> table = [] {
+        std::vector<std::vector<uint16_t>> opcodes(OP_COUNT);
+        for (unsigned int opcode = 0; opcode <= 0xFFFF; opcode++) {
+            opcodes[decode_table[opcode].op].push_back(static_cast<uint16_t>(opcode));
+        }
+        return opcodes;
+    }();
+    return table;
+}
+
+// An instruction for a program of `count` words, two words for F000. Jumps
+// and calls go to one of the program's words.
+void random_instruction(Random &random, unsigned int count, std::vector<uint8_t> &rom) {
+    const std::vector<uint16_t> &opcodes = opcodes_by_op()[1 + below(random, OP_COUNT - 1)];
+    uint16_t opcode = opcodes[below(random, opcodes.size())];
+    uint8_t op = decode_table[opcode].op;
+    if (op == OP_1nnn || op == OP_2nnn || op == OP_Bnnn) {
+        opcode = (opcode & 0xF000u) | (START_ADDRESS + 2 * below(random, count));
+    }
+    rom.push_back(opcode >> 8u);
+    rom.push_back(opcode & 0xFFu);
+    if (op == OP_F000) {
+        rom.push_back(random.next_byte());
+        rom.push_back(random.next_byte());
+    }
+}
+
+void random_header(Random &random, FuzzCase &fuzz_case) {
+    fuzz_case.quirks = static_cast<Quirks>(below(random, 5));
+    fuzz_case.frames = 1 + random.next_byte();
+    fuzz_case.cycles_per_frame = 1 + below(random, FUZZ_MAX_CYCLES_PER_FRAME);
+    fuzz_case.key_rate = random.next_byte();
+    for (unsigned int i = 0; i < 8; i++) {
+        fuzz_case.seed = fuzz_case.seed << 8u | random.next_byte();
+    }
+}
+
+}
+
+bool FuzzCase::decode(const uint8_t *data, size_t size) {
+    if (size < FUZZ_HEADER_SIZE || size - FUZZ_HEADER_SIZE > MAX_ROM_SIZE) {
+        return false;
+    }
+    quirks = static_cast<Quirks>(data[0] % 5);
+    frames = data[1] + 1u;
+    cycles_per_frame = data[2] % FUZZ_MAX_CYCLES_PER_FRAME + 1;
+    key_rate = data[3];
+    seed = 0;
+    for (unsigned int i = 0; i < 8; i++) {
+        seed |= static_cast<uint64_t>(data[4 + i]) << (8 * i);
+    }
+    rom.assign(data + FUZZ_HEADER_SIZE, data + size);
+    return true;
+}
+
+std::vector<uint8_t> FuzzCase::encode() const {
+    std::vector<uint8_t> data(FUZZ_HEADER_SIZE + rom.size());
+    data[0] = static_cast<uint8_t>(quirks);
+    data[1] = frames - 1;
+    data[2] = cycles_per_frame - 1;
+    data[3] = key_rate;
+    for (unsigned int i = 0; i < 8; i++) {
+        data[4 + i] = seed >> (8 * i);
+    }
+    std::copy(rom.begin(), rom.end(), data.begin() + FUZZ_HEADER_SIZE);
+    return data;
+}
+
+bool FuzzCase::read(char const *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!decode(data.data(), data.size())) {
+        std::cerr << filename << " is not a fuzz case" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FuzzCase::write(char const *filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data = encode();
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return file.good();
+}
+
+bool find_divergence(const FuzzCase &fuzz_case, Divergence &divergence) {
+    // far too big for the stack, all of them
+    auto reference = std::make_unique<Chip8>();
+    std::unique_ptr<Chip8> machines[ENGINE_COUNT];
+    Lockstep lockstep(1, fuzz_case.quirks);
+
+    reference->core = Core::Switch;
+    reference->set_quirks(fuzz_case.quirks);
+    reference->seed(fuzz_case.seed);
+    if (!reference->load_rom(fuzz_case.rom.data(), fuzz_case.rom.size())) {
+        return false;
+    }
+    for (unsigned int i = 0; i < ENGINE_COUNT; i++) {
+        machines[i] = std::make_unique<Chip8>();
+        machines[i]->core = engines[i].core;
+        // the chunks are short, and the native code has to run in them
+        machines[i]->jit_min_cycles = 0;
+        machines[i]->set_quirks(fuzz_case.quirks);
+        machines[i]->seed(fuzz_case.seed);
+        machines[i]->load_rom(fuzz_case.rom.data(), fuzz_case.rom.size());
+    }
+    lockstep.load_rom(fuzz_case.rom.data(), fuzz_case.rom.size());
+    lockstep.seed(0, fuzz_case.seed);
+
+    auto diverged = [&](const char *engine, unsigned int frame, uint64_t instruction, const std::string &detail) {
+        Snapshot expected;
+        reference->save(expected);
+        divergence.engine = engine;
+        divergence.frame = frame;
+        divergence.instruction = instruction;
+        divergence.pc = expected.pc;
+        divergence.detail = detail;
+        return true;
+    };
+
+    Random schedule;
+    schedule.seed(fuzz_case.seed ^ SCHEDULE_SEED);
+    uint64_t executed = 0;
+    for (unsigned int frame = 0; frame < fuzz_case.frames; frame++) {
+        // keys change between frames, like they do with the frontend
+        if (schedule.next_byte() < fuzz_case.key_rate) {
+            reference->keypad[schedule.next_byte() % KEY_COUNT] ^= 1u;
+            for (auto &machine : machines) {
+                memcpy(machine->keypad, reference->keypad, KEY_COUNT);
+            }
+            memcpy(lockstep.keypad(0), reference->keypad, KEY_COUNT);
+        }
+
+        // the engines run whole chunks, so they have to stop at an unknown
+        // opcode by themselves, where the reference did
+        unsigned int left = fuzz_case.cycles_per_frame;
+        while (left > 0) {
+            unsigned int chunk = schedule.next_byte() & 1u ? 1 : 1 + schedule.next_byte() % left;
+            left -= chunk;
+
+            for (unsigned int ran = 0; ran < chunk && !reference->crashed(); ran++) {
+                reference->cycle();
+                executed++;
+            }
+
+            uint64_t expected = reference->state_hash();
+            for (unsigned int i = 0; i < ENGINE_COUNT; i++) {
+                machines[i]->run(chunk);
+                if (machines[i]->state_hash() != expected) {
+                    Snapshot a, b;
+                    reference->save(a);
+                    machines[i]->save(b);
+                    return diverged(engines[i].name, frame, executed, difference(a, b));
+                }
+            }
+            lockstep.run(chunk);
+        }
+        reference->tick_timers();
+        for (auto &machine : machines) {
+            machine->tick_timers();
+        }
+        lockstep.tick_timers();
+        if (lockstep.hash(0) != reference->hash()) {
+            return diverged("lockstep", frame, executed, "state hash differs");
+        }
+
+        // a stopped machine stays as it is
+        if (reference->crashed()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+FuzzCase minimize(const FuzzCase &fuzz_case, const Divergence &divergence) {
+    FuzzCase best = fuzz_case;
+    unsigned int frame = divergence.frame;
+
+    // keeps a change that still makes the same engine diverge
+    auto attempt = [&](const FuzzCase &candidate) {
+        Divergence found;
+        if (!find_divergence(candidate, found) || found.engine != divergence.engine) {
+            return false;
+        }
+        best = candidate;
+        frame = found.frame;
+        best.frames = frame + 1;
+        return true;
+    };
+
+    // nothing after the frame it diverged in matters
+    FuzzCase candidate = best;
+    candidate.frames = frame + 1;
+    attempt(candidate);
+
+    candidate = best;
+    candidate.key_rate = 0;
+    attempt(candidate);
+
+    // cut the end of the ROM off, in smaller pieces each time one won't go
+    for (size_t cut = best.rom.size() / 2; cut > 0; cut /= 2) {
+        while (cut <= best.rom.size()) {
+            candidate = best;
+            candidate.rom.resize(best.rom.size() - cut);
+            if (!attempt(candidate)) {
+                break;
+            }
+        }
+    }
+
+    // then blank out runs of instructions, halving the run length each pass
+    size_t words = best.rom.size() / 2;
+    for (size_t run = words / 2 > 0 ? words / 2 : 1; run > 0; run /= 2) {
+        for (size_t start = 0; start + run <= best.rom.size() / 2; start += run) {
+            candidate = best;
+            bool changed = false;
+            for (size_t word = start; word < start + run; word++) {
+                changed |= candidate.rom[2 * word] != NOP[0] || candidate.rom[2 * word + 1] != NOP[1];
+                candidate.rom[2 * word] = NOP[0];
+                candidate.rom[2 * word + 1] = NOP[1];
+            }
+            if (changed) {
+                attempt(candidate);
+            }
+        }
+    }
+    return best;
+}
+
+FuzzCase random_program(Random &random) {
+    FuzzCase fuzz_case;
+    random_header(random, fuzz_case);
+    unsigned int count = 2 + below(random, 255);
+    while (fuzz_case.rom.size() < 2 * count) {
+        random_instruction(random, count, fuzz_case.rom);
+    }
+    return fuzz_case;
+}
+
+FuzzCase mutate_rom(const std::vector<uint8_t> &rom, Random &random) {
+    FuzzCase fuzz_case;
+    random_header(random, fuzz_case);
+    fuzz_case.cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    fuzz_case.rom = rom;
+    if (rom.empty()) {
+        return fuzz_case;
+    }
+
+    unsigned int words = rom.size() / 2 > 0 ? rom.size() / 2 : 1;
+    unsigned int changes = 1 + below(random, 8);
+    for (unsigned int i = 0; i < changes; i++) {
+        size_t at = below(random, rom.size());
+        switch (below(random, 3)) {
+            case 0:
+                fuzz_case.rom[at] ^= 1u << below(random, 8);
+                break;
+            case 1:
+                fuzz_case.rom[at] = random.next_byte();
+                break;
+            default: {
+                std::vector<uint8_t> instruction;
+                random_instruction(random, words, instruction);
+                at &= ~static_cast<size_t>(1);
+                for (size_t b = 0; b < instruction.size() && at + b < rom.size(); b++) {
+                    fuzz_case.rom[at + b] = instruction[b];
+                }
+            }
+        }
+    }
+    return fuzz_case;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+// Bytes in front of the ROM in an encoded FuzzCase
+const size_t FUZZ_HEADER_SIZE = 12;
+
+// Most instructions per frame a case runs
+const unsigned int FUZZ_MAX_CYCLES_PER_FRAME = 32;
+
+// A program for the differential tester and how to run it. Cases are stored
+// as plain bytes, and any bytes long enough make a valid case, so a fuzzer
+// can feed its inputs straight to find_divergence():
+//
+//   byte 0      quirks profile, mod 5
+//   byte 1      frames to run, minus 1
+//   byte 2      instructions per frame, minus 1, mod FUZZ_MAX_CYCLES_PER_FRAME
+//   byte 3      chance out of 256 that a key is pressed or let go each frame
+//   bytes 4-11  seed, little-endian
+//   the rest    the ROM
+struct FuzzCase {
+    Quirks quirks = Quirks::Legacy;
+    unsigned int frames = 1;
+    unsigned int cycles_per_frame = 1;
+    uint8_t key_rate{};
+    uint64_t seed{}; // for Cxkk, the keypad and where the engines are compared
+    std::vector<uint8_t> rom;
+
+    // Returns false when there's no room for the header or the ROM doesn't
+    // fit in memory
+    bool decode(const uint8_t *data, size_t size);
+    std::vector<uint8_t> encode() const;
+
+    bool read(char const *filename);
+    bool write(char const *filename) const;
+};
+
+// Where an engine first ended up in a different state from the reference
+struct Divergence {
+    std::string engine;     // "switch", "table", "block", "jit" or "lockstep"
+    unsigned int frame{};
+    uint64_t instruction{}; // instructions the reference had run by then
+    uint16_t pc{};          // where the reference was
+    std::string detail;     // what differs, e.g. "V3 is 0x12, should be 0x13"
+};
+
+// Run a case on the reference, Chip8::cycle() on the switch core one
+// instruction at a time, which runs its own nested switch rather than the
+// decode table and handlers the other engines use. Every other engine runs
+// side by side with it: Chip8::run() on each core, and Lockstep. The
+// engines run the same number of instructions in chunks, often of a single
+// instruction, and their full state is compared with the reference's after
+// each chunk, Lockstep's after each frame. That includes whether they've
+// stopped at an unknown opcode; the run ends after the frame the reference
+// stops in. Returns true and says where if an engine diverged.
+bool find_divergence(const FuzzCase &fuzz_case, Divergence &divergence);
+
+// Shrink a diverging case as far as it goes while the same engine still
+// diverges: fewer frames, no keypad, a shorter ROM and as many of its
+// instructions as possible replaced with ones that do nothing
+FuzzCase minimize(const FuzzCase &fuzz_case, const Divergence &divergence);
+
+// A case running a stream of random instructions, with every jump and call
+// landing inside the stream
+FuzzCase random_program(Random &random);
+
+// A case running a ROM with a few random bytes, bits and instructions changed
+FuzzCase mutate_rom(const std::vector<uint8_t> &rom, Random &random);
@@ -0,0 +1,22 @@
+#include "fuzz.h"
+#include <cstdio>
+#include <cstdlib>
+
+// Entry point for libFuzzer, built as chip8-libfuzzer with -DCHIP8_FUZZ=ON.
+// Every input is run as a FuzzCase: an engine diverging from the reference
+// aborts, and the sanitizers catch reads and writes out of bounds.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    FuzzCase fuzz_case;
+    if (!fuzz_case.decode(data, size)) {
+        return 0;
+    }
+
+    Divergence divergence;
+    if (find_divergence(fuzz_case, divergence)) {
+        fprintf(stderr, "%s diverged after %llu instructions (frame %u, pc 0x%04X): %s\n",
+                divergence.engine.c_str(), static_cast<unsigned long long>(divergence.instruction),
+                divergence.frame, divergence.pc, divergence.detail.c_str());
+        std::abort();
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "chip8.h"
+#include "fuzz.h"
+#include "rom.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage(char const *program) {
+    std::cerr << "Usage: " << program << " [options] [case...]\n"
+              << "  --runs <n>      random cases to run (default 10000)\n"
+              << "  --seed <n>      seed for making them up, for reproducible runs\n"
+              << "  --roms <path>   ROM or directory of ROMs to mutate (default " << CHIP8_ROM_DIR << ")\n"
+              << "  --out <file>    where to write a diverging case, minimized (default divergence.case)\n"
+              << "  With cases, only those are run, e.g. to check a fix\n";
+    std::exit(EXIT_FAILURE);
+}
+
+// The case being run, written out if something in it makes the process exit
+static const FuzzCase *running = nullptr;
+static std::string crash_file;
+
+static void save_running() {
+    if (running != nullptr && running->write(crash_file.c_str())) {
+        std::cerr << "Exited while running a case, it's in " << crash_file << std::endl;
+    }
+}
+
+static void print_case(const FuzzCase &fuzz_case) {
+    static const char *const quirks[] = {"legacy", "vip", "chip48", "schip", "modern"};
+    printf("quirks %s, %u frames of %u instructions, key rate %u, seed 0x%016llx\n",
+           quirks[static_cast<uint8_t>(fuzz_case.quirks)], fuzz_case.frames, fuzz_case.cycles_per_frame,
+           fuzz_case.key_rate, static_cast<unsigned long long>(fuzz_case.seed));
+
+    // runs of blanked out instructions are left out
+    bool skipping = false;
+    for (size_t i = 0; i + 1 < fuzz_case.rom.size(); i += 2) {
+        uint16_t opcode = fuzz_case.rom[i] << 8u | fuzz_case.rom[i + 1];
+        if (opcode == 0x8000) {
+            if (!skipping) {
+                printf("  ...\n");
+            }
+            skipping = true;
+            continue;
+        }
+        skipping = false;
+        printf("  %03zX  %04X  %s\n", START_ADDRESS + i, opcode, disassemble(opcode).c_str());
+    }
+}
+
+static void print_divergence(const Divergence &divergence) {
+    printf("%s diverged after %llu instructions (frame %u, pc 0x%04X): %s\n", divergence.engine.c_str(),
+           static_cast<unsigned long long>(divergence.instruction), divergence.frame, divergence.pc,
+           divergence.detail.c_str());
+}
+
+// Run the given case files, fails if any of them diverges
+static int run_cases(const std::vector<std::string> &files) {
+    int status = 0;
+    for (const std::string &file : files) {
+        FuzzCase fuzz_case;
+        if (!fuzz_case.read(file.c_str())) {
+            std::exit(EXIT_FAILURE);
+        }
+        running = &fuzz_case;
+        Divergence divergence;
+        bool diverged = find_divergence(fuzz_case, divergence);
+        running = nullptr;
+
+        printf("%s: ", file.c_str());
+        if (diverged) {
+            print_divergence(divergence);
+            print_case(fuzz_case);
+            status = EXIT_FAILURE;
+        } else {
+            printf("ok\n");
+        }
+    }
+    return status;
+}
+
+// Check every core against the reference interpreter on random programs and
+// mutated ROMs, and shrink the first case that tells them apart
+int main(int argc, char *argv[]) {
+    unsigned long long runs = 10000;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    std::string roms = CHIP8_ROM_DIR;
+    std::string out = "divergence.case";
+    std::vector<std::string> cases;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--runs" && has_value) {
+            runs = std::stoull(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--roms" && has_value) {
+            roms = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            out = argv[++i];
+        } else if (arg[0] != '-') {
+            cases.push_back(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    crash_file = out + ".crash";
+    std::atexit(save_running);
+    if (!cases.empty()) {
+        return run_cases(cases);
+    }
+
+    std::vector<std::string> files;
+    std::error_code error;
+    if (std::filesystem::is_directory(roms, error)) {
+        for (const auto &entry : std::filesystem::directory_iterator(roms, error)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(roms);
+    }
+    std::vector<std::vector<uint8_t>> images;
+    for (const std::string &file : files) {
+        std::shared_ptr<const Rom> rom = RomCache::load(file.c_str());
+        if (!rom) {
+            std::cerr << "ROM not loaded: " << file << std::endl;
+            return EXIT_FAILURE;
+        }
+        images.emplace_back(rom->data(), rom->data() + rom->size());
+    }
+
+    std::cout << "Seed " << seed << std::endl;
+    Random random;
+    random.seed(seed);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long run = 0; run < runs; run++) {
+        // every other case is a mutated ROM, when there are any
+        FuzzCase fuzz_case = images.empty() || run % 2 == 0
+                             ? random_program(random)
+                             : mutate_rom(images[run / 2 % images.size()], random);
+
+        running = &fuzz_case;
+        Divergence divergence;
+        bool diverged = find_divergence(fuzz_case, divergence);
+        if (!diverged) {
+            running = nullptr;
+            continue;
+        }
+
+        printf("Case %llu: ", run);
+        print_divergence(divergence);
+        FuzzCase smallest = minimize(fuzz_case, divergence);
+        running = nullptr;
+        find_divergence(smallest, divergence);
+        printf("Minimized: ");
+        print_divergence(divergence);
+        print_case(smallest);
+        if (smallest.write(out.c_str())) {
+            printf("Written to %s\n", out.c_str());
+        }
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Ran " << runs << " cases in " << elapsed.count() << " s, no divergence" << std::endl;
+    return 0;
+}
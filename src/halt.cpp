@@ -0,0 +1,40 @@
+#include "halt.h"
+
+bool HaltDetector::update(Chip8 &chip8) {
+    if (found != 0) {
+        return true;
+    }
+    if (++frames < HALT_CHECK_INTERVAL) {
+        return false;
+    }
+    frames = 0;
+
+    uint64_t hash = chip8.state_hash();
+    if (checkpoint) {
+        length++;
+        if (hash == checkpoint_hash && chip8.matches(*checkpoint)) {
+            found = length * HALT_CHECK_INTERVAL;
+            return true;
+        }
+        if (length < power) {
+            return false;
+        }
+        // not back yet, move the checkpoint up and wait twice as long
+        power *= 2;
+    } else {
+        checkpoint = std::make_unique<Snapshot>();
+    }
+
+    chip8.save(*checkpoint);
+    checkpoint_hash = hash;
+    length = 0;
+    return false;
+}
+
+uint64_t HaltDetector::period() const {
+    return found;
+}
+
+uint64_t HaltDetector::frames_left(uint64_t frames) const {
+    return found != 0 ? frames % found : frames;
+}
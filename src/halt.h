@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "snapshot.h"
+
+// Frames between the looks HaltDetector takes at a machine
+const unsigned int HALT_CHECK_INTERVAL = 64;
+
+// Notices when a machine has stopped getting anywhere. Once there's no more
+// input to come, a machine that gets back into a state it was in before
+// goes round the same cycle of states forever, e.g. a test ROM that has
+// finished and jumps to itself. Every whole lap of the cycle ends where it
+// started, so a run can skip them and still end in the state running every
+// frame would have left it in.
+//
+// The state is sampled every HALT_CHECK_INTERVAL frames with
+// Chip8::state_hash() and the samples are searched for a cycle with Brent's
+// algorithm, which keeps a single sample to compare against. A cycle is
+// found within about twice its length after the machine enters it, and a
+// matching hash is checked against the full state before it counts.
+class HaltDetector {
+public:
+    // Call after every frame run with no input left to come. Returns true
+    // once the machine has been seen to repeat itself.
+    bool update(Chip8 &chip8);
+
+    // Length of the cycle in frames, 0 until it's found
+    uint64_t period() const;
+
+    // How many of the next `frames` frames actually have to be run to end in
+    // the same state as running all of them
+    uint64_t frames_left(uint64_t frames) const;
+
+private:
+    unsigned int frames = 0; // since the last sample
+    uint64_t power = 1;      // samples the checkpoint is kept for
+    uint64_t length = 0;     // samples since the checkpoint
+    uint64_t checkpoint_hash{};
+    std::unique_ptr<Snapshot> checkpoint;
+    uint64_t found = 0;
+};
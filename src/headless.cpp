@@ -0,0 +1,460 @@
+#include "audio.h"
+#include "batch.h"
+#include "chip8.h"
+#include "halt.h"
+#include "lockstep.h"
+#include "movie.h"
+#include "profiler.h"
+#include "rom.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "snapshot.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+
+static void usage(char const *program) {
+    std::cerr << "Usage: " << program << " [options] <ROM>\n"
+              << "  --cycles <n>    run n instructions (default 1000000)\n"
+              << "  --frames <n>    run n frames instead\n"
+              << "  --ipf <n>       instructions per frame (default " << DEFAULT_CYCLES_PER_FRAME << ")\n"
+              << "  --core <name>   switch, table, block or jit (default table)\n"
+              << "  --quirks <name> legacy, vip, chip48, schip or modern (default legacy)\n"
+              << "  --instances <n> run n copies of the ROM seeded 0 to n-1 (default 1), only with\n"
+              << "                  the options above and --threads, --lockstep and --no-halt\n"
+              << "  --threads <n>   worker threads for --instances (default all cores)\n"
+              << "  --lockstep      run the --instances on the lockstep engine instead of a --core\n"
+              << "  --realtime      pace frames at 60 Hz instead of running flat out\n"
+              << "  --no-halt       run every frame, even once the machine is stuck in a cycle\n"
+              << "  --load <file>   start from a snapshot instead of a fresh machine, under its --quirks\n"
+              << "  --save <file>   write a snapshot of the machine when done\n"
+              << "  --seed <n>      seed the random number generator, for reproducible runs\n"
+              << "  --record <file> write the run to a movie file\n"
+              << "  --replay <file> replay a movie and check it ends in the recorded state\n"
+              << "  --trace <file>  write every instruction executed to a trace, see chip8-trace\n"
+              << "  --audio <file>  write the sound to a WAV file, or make it and throw it away with null\n"
+              << "  --profile       print where the time went (needs -DCHIP8_PROFILE=ON)\n"
+              << "  --folded <file> write call chains for flamegraph.pl (needs -DCHIP8_PROFILE=ON)\n";
+    std::exit(EXIT_FAILURE);
+}
+
+static bool parse_core(const std::string &name, Core &core) {
+    if (name == "switch") {
+        core = Core::Switch;
+    } else if (name == "table") {
+        core = Core::Table;
+    } else if (name == "block") {
+        core = Core::Block;
+    } else if (name == "jit") {
+        core = Core::Jit;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Run many copies of a ROM, each seeded differently, on the batch runner
+static int run_instances(char const *rom, unsigned int instances, unsigned int threads, Core core,
+                         Quirks quirks, unsigned long long frames, unsigned int cycles_per_frame,
+                         bool stop_when_halted) {
+    auto image = RomCache::load(rom);
+    if (!image) {
+        std::cerr << "ROM not loaded!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BatchJob> jobs(instances);
+    for (unsigned int i = 0; i < instances; i++) {
+        jobs[i].rom = image;
+        jobs[i].seed = i;
+        jobs[i].frames = frames;
+        jobs[i].cycles_per_frame = cycles_per_frame;
+        jobs[i].quirks = quirks;
+        jobs[i].stop_when_halted = stop_when_halted;
+    }
+
+    BatchRunner runner(threads, core);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = runner.run(jobs);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::set<uint64_t> hashes;
+    unsigned int halted = 0;
+    unsigned int crashed = 0;
+    unsigned long long skipped = 0;
+    unsigned long long lost = 0; // frames after a crash, which don't run either
+    for (unsigned int i = 0; i < instances; i++) {
+        const BatchResult &result = results[i];
+        if (!result.loaded) {
+            std::cerr << "ROM not loaded!" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (result.crashed_at != 0) {
+            std::cerr << "Instance " << i << " (seed " << jobs[i].seed << ") stopped at unknown opcode "
+                      << std::hex << std::uppercase << result.crash_opcode << " at 0x" << result.crash_pc
+                      << std::dec << std::nouppercase << " in frame " << result.crashed_at << std::endl;
+            crashed++;
+            lost += frames - result.crashed_at;
+        }
+        hashes.insert(result.hash);
+        halted += result.halted_at != 0 ? 1 : 0;
+        skipped += result.skipped;
+    }
+
+    // the rate only counts the frames that actually ran
+    double seconds = elapsed.count();
+    unsigned long long cycles = frames * cycles_per_frame;
+    double total = (static_cast<double>(frames) * instances - skipped - lost) * cycles_per_frame;
+    std::cout << "Ran " << instances << " instances of " << cycles << " instructions in "
+              << seconds << " s\n"
+              << (seconds > 0 ? total / seconds / 1e6 : 0) << " million instructions/s, "
+              << hashes.size() << " distinct final states" << std::endl;
+    if (halted > 0) {
+        std::cout << halted << " instances halted, " << skipped << " frames skipped" << std::endl;
+    }
+    if (crashed > 0) {
+        std::cerr << crashed << " of " << instances << " instances stopped at an unknown opcode" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+// Run many copies of a ROM, each seeded differently, on the lockstep engine
+static int run_lockstep(char const *rom, unsigned int instances, Quirks quirks,
+                        unsigned long long frames, unsigned int cycles_per_frame) {
+    auto image = RomCache::load(rom);
+    Lockstep machines(instances, quirks);
+    if (!image || !machines.load_rom(image->data(), image->size())) {
+        std::cerr << "ROM not loaded!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (unsigned int i = 0; i < instances; i++) {
+        machines.seed(i, i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        machines.run_frame(cycles_per_frame);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::set<uint64_t> hashes;
+    unsigned int crashed = 0;
+    for (unsigned int i = 0; i < instances; i++) {
+        hashes.insert(machines.hash(i));
+        if (machines.crashed(i)) {
+            std::cerr << "Instance " << i << " (seed " << i << ") stopped at unknown opcode " << std::hex
+                      << std::uppercase << machines.next_opcode(i) << " at 0x" << machines.next_address(i)
+                      << std::dec << std::nouppercase << std::endl;
+            crashed++;
+        }
+    }
+
+    double seconds = elapsed.count();
+    unsigned long long cycles = frames * cycles_per_frame;
+    double total = static_cast<double>(cycles) * instances;
+    std::cout << "Ran " << instances << " instances of " << cycles << " instructions in lockstep in "
+              << seconds << " s\n"
+              << (seconds > 0 ? total / seconds / 1e6 : 0) << " million instructions/s, "
+              << hashes.size() << " distinct final states" << std::endl;
+    if (crashed > 0) {
+        std::cerr << crashed << " of " << instances << " instances stopped at an unknown opcode" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+// Run a ROM without a window and report how fast it went
+int main(int argc, char *argv[]) {
+    unsigned long long cycles = 1000000;
+    unsigned long long frames = 0;
+    unsigned int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    Core core = Core::Table;
+    bool core_given = false;
+    Quirks quirks = Quirks::Legacy;
+    bool quirks_given = false;
+    unsigned int instances = 1;
+    unsigned int threads = 0;
+    bool lockstep = false;
+    bool realtime = false;
+    bool stop_when_halted = true;
+    char const *load = nullptr;
+    char const *save = nullptr;
+    char const *record = nullptr;
+    char const *replay = nullptr;
+    char const *trace = nullptr;
+    char const *audio = nullptr;
+    bool profile = false;
+    char const *folded = nullptr;
+    bool seeded = false;
+    uint64_t seed = 0;
+    char const *rom = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--cycles" && has_value) {
+            cycles = std::stoull(argv[++i]);
+        } else if (arg == "--frames" && has_value) {
+            frames = std::stoull(argv[++i]);
+        } else if (arg == "--ipf" && has_value) {
+            cycles_per_frame = std::stoul(argv[++i]);
+        } else if (arg == "--core" && has_value) {
+            if (!parse_core(argv[++i], core)) {
+                usage(argv[0]);
+            }
+            core_given = true;
+        } else if (arg == "--quirks" && has_value) {
+            if (!parse_quirks(argv[++i], quirks)) {
+                usage(argv[0]);
+            }
+            quirks_given = true;
+        } else if (arg == "--instances" && has_value) {
+            instances = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--lockstep") {
+            lockstep = true;
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else if (arg == "--no-halt") {
+            stop_when_halted = false;
+        } else if (arg == "--load" && has_value) {
+            load = argv[++i];
+        } else if (arg == "--save" && has_value) {
+            save = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            seed = std::stoull(argv[++i]);
+            seeded = true;
+        } else if (arg == "--record" && has_value) {
+            record = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            replay = argv[++i];
+        } else if (arg == "--trace" && has_value) {
+            trace = argv[++i];
+        } else if (arg == "--audio" && has_value) {
+            audio = argv[++i];
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--folded" && has_value) {
+            folded = argv[++i];
+        } else if (rom == nullptr && arg[0] != '-') {
+            rom = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (rom == nullptr || cycles_per_frame == 0 || instances == 0) {
+        usage(argv[0]);
+    }
+
+#ifndef CHIP8_PROFILE
+    if (profile || folded != nullptr) {
+        std::cerr << "Profiling needs a build configured with -DCHIP8_PROFILE=ON" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+#endif
+
+    // Movies always start from a fresh machine
+    if (load != nullptr && (record != nullptr || replay != nullptr)) {
+        usage(argv[0]);
+    }
+
+    // Instances are fresh machines with seeds of their own, and nothing
+    // that reads or writes a file for a single machine applies to them. The
+    // lockstep engine doesn't have cores to pick from.
+    bool single_only = load != nullptr || save != nullptr || seeded || record != nullptr || replay != nullptr
+                       || trace != nullptr || audio != nullptr || realtime || profile || folded != nullptr;
+    if ((instances > 1 && single_only) || (lockstep && core_given)) {
+        usage(argv[0]);
+    }
+
+    // A movie brings its own seed, speed and length
+    Movie movie;
+    if (replay != nullptr) {
+        if (!movie.read(replay)) {
+            std::exit(EXIT_FAILURE);
+        }
+        seed = movie.seed;
+        seeded = true;
+        quirks = movie.quirks;
+        cycles_per_frame = movie.cycles_per_frame;
+        frames = movie.frames;
+        if (cycles_per_frame == 0) {
+            usage(argv[0]);
+        }
+    }
+
+    if (record != nullptr && !seeded) {
+        seed = std::chrono::system_clock::now().time_since_epoch().count();
+        seeded = true;
+    }
+
+    if (frames == 0) {
+        frames = (cycles + cycles_per_frame - 1) / cycles_per_frame;
+    }
+    cycles = frames * cycles_per_frame;
+
+    if (instances > 1 && lockstep) {
+        return run_lockstep(rom, instances, quirks, frames, cycles_per_frame);
+    }
+    if (instances > 1) {
+        return run_instances(rom, instances, threads, core, quirks, frames, cycles_per_frame,
+                             stop_when_halted);
+    }
+
+    Chip8 chip8;
+    chip8.core = core;
+    chip8.set_quirks(quirks);
+    if (seeded) {
+        chip8.seed(seed);
+    }
+    if (!chip8.load_rom(rom)) {
+        std::cerr << "ROM not loaded!" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    Snapshot snapshot;
+    if (load != nullptr) {
+        if (!snapshot.read(load)) {
+            std::exit(EXIT_FAILURE);
+        }
+        // a snapshot brings its own profile, which can't be changed mid-game
+        if (quirks_given && snapshot.quirks != quirks) {
+            std::cerr << load << " was saved with --quirks " << quirks_name(snapshot.quirks) << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        chip8.restore(snapshot);
+    }
+
+    Tracer tracer;
+    if (trace != nullptr) {
+        if (!tracer.open(trace)) {
+            std::exit(EXIT_FAILURE);
+        }
+        chip8.tracer = &tracer;
+    }
+
+#ifdef CHIP8_PROFILE
+    Profiler profiler;
+    if (profile || folded != nullptr) {
+        chip8.profiler = &profiler;
+    }
+#endif
+
+    // the null sink makes the samples like the WAV one does, it just doesn't keep them
+    AudioSynth synth;
+    WavWriter wav;
+    int16_t samples[AUDIO_FRAME_SAMPLES];
+    if (audio != nullptr && std::string(audio) != "null" && !wav.open(audio)) {
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Once the movie's input has all been played, the run stops early if the
+    // machine gets stuck in a cycle, unless every frame is wanted
+    stop_when_halted = stop_when_halted && !realtime && trace == nullptr && audio == nullptr
+                       && !profile && folded == nullptr;
+    HaltDetector halt;
+    unsigned long long skipped = 0;
+
+    // Emulation loop, one frame at a time
+    unsigned long long draws = 0;
+    Scheduler scheduler(realtime);
+    auto start = std::chrono::steady_clock::now();
+    size_t next = 0;
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        scheduler.wait_for_frame();
+        play_input(movie.input, next, frame, chip8.keypad);
+        chip8.run_frame(cycles_per_frame);
+        if (chip8.crashed()) {
+            break;
+        }
+        if (audio != nullptr) {
+            synth.set(audio_frame(chip8, frame));
+            synth.render(samples, AUDIO_FRAME_SAMPLES);
+            wav.write(samples, AUDIO_FRAME_SAMPLES);
+        }
+        if (chip8.draw_flag) {
+            chip8.draw_flag = false;
+            draws++;
+        }
+        if (stop_when_halted && next == movie.input.size() && halt.update(chip8)) {
+            // every whole lap of the cycle ends where it started
+            unsigned long long rest = frames - frame - 1;
+            unsigned long long left = halt.frames_left(rest);
+            for (unsigned long long i = 0; i < left; i++) {
+                chip8.run_frame(cycles_per_frame);
+            }
+            skipped = rest - left;
+            std::cout << "Halted at frame " << frame + 1 << ", repeating every " << halt.period()
+                      << " frames" << std::endl;
+            break;
+        }
+    }
+    tracer.close(); // the time includes writing the rest of the trace
+    if (!wav.close()) {
+        std::cerr << "Couldn't write " << audio << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+#ifdef CHIP8_PROFILE
+    if (profile) {
+        profiler.report(std::cout);
+        std::cout << std::endl;
+    }
+    if (folded != nullptr) {
+        std::ofstream file(folded);
+        if (!file.is_open()) {
+            std::cerr << "Couldn't open file " << folded << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        profiler.write_folded(file);
+    }
+#endif
+
+    // the trace written so far shows how it got there
+    if (chip8.crashed()) {
+        std::cerr << "Unknown opcode " << std::hex << std::uppercase << chip8.next_opcode() << " at 0x"
+                  << chip8.next_address() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (replay != nullptr && chip8.hash() != movie.final_hash) {
+        std::cerr << "Replay of " << replay << " diverged from the recording" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (record != nullptr) {
+        movie.seed = seed;
+        movie.quirks = quirks;
+        movie.cycles_per_frame = cycles_per_frame;
+        movie.frames = frames;
+        movie.final_hash = chip8.hash();
+        if (!movie.write(record)) {
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (save != nullptr) {
+        chip8.save(snapshot);
+        if (!snapshot.write(save)) {
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // the rates only count the frames that actually ran
+    double seconds = elapsed.count();
+    unsigned long long ran = frames - skipped;
+    std::cout << "Ran " << cycles << " instructions (" << frames << " frames, "
+              << draws << " with drawing";
+    if (skipped > 0) {
+        std::cout << ", " << skipped << " skipped";
+    }
+    std::cout << ") in " << seconds << " s\n"
+              << (seconds > 0 ? ran * cycles_per_frame / seconds / 1e6 : 0) << " million instructions/s, "
+              << (seconds > 0 ? ran / seconds : 0) << " frames/s" << std::endl;
+    return 0;
+}
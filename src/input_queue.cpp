@@ -0,0 +1,27 @@
+#include "input_queue.h"
+#include <chrono>
+
+size_t InputQueue::drain(uint64_t time, uint8_t keypad[]) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    size_t end = head.load(std::memory_order_acquire);
+    uint16_t changed = 0;
+    size_t applied = 0;
+    for (; position != end; position++) {
+        const InputEvent &event = ring[position & (INPUT_RING_SIZE - 1)];
+        if (event.time > time || (event.key < KEY_COUNT && (changed >> event.key) & 1u)) {
+            break;
+        }
+        if (event.key < KEY_COUNT) {
+            keypad[event.key] = event.pressed ? 1 : 0;
+            changed |= 1u << event.key;
+        }
+        applied++;
+    }
+    tail.store(position, std::memory_order_release);
+    return applied;
+}
+
+uint64_t InputQueue::now() {
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
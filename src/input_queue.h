@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// Key events buffered between the frontend and the emulator, a power of two
+const size_t INPUT_RING_SIZE = 256;
+
+// A key going down or up, stamped with when the frontend saw it
+struct InputEvent {
+    uint64_t time; // nanoseconds on the steady clock, see InputQueue::now()
+    uint8_t key;   // 0-F
+    bool pressed;
+};
+
+// Key events from the frontend's thread to the emulator's. The frontend
+// puts events into a ring buffer that only it writes to and the emulator
+// takes them out at the start of each frame, with no locks in between, so
+// input reaches the machine at frame boundaries only and always one frame
+// after it happened at most.
+class InputQueue {
+public:
+    // Frontend side: queue an event. Returns false and drops it if the
+    // emulator is a whole ring behind.
+    bool push(const InputEvent &event) {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == INPUT_RING_SIZE) {
+            return false;
+        }
+        ring[position & (INPUT_RING_SIZE - 1)] = event;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Emulator side, once per frame: apply the events stamped up to `time`
+    // to a keypad, in order. Each key changes at most once per frame, so a
+    // tap shorter than a frame is still held down for one; a second change
+    // to a key waits for the next frame, along with everything after it.
+    // Returns the number of events applied.
+    size_t drain(uint64_t time, uint8_t keypad[]);
+
+    // The current time on the clock events are stamped with
+    static uint64_t now();
+
+private:
+    std::vector<InputEvent> ring = std::vector<InputEvent>(INPUT_RING_SIZE);
+    alignas(64) std::atomic<size_t> head{0}; // next event to fill, owned by the frontend
+    alignas(64) std::atomic<size_t> tail{0}; // next event to apply, owned by the emulator
+};
@@ -0,0 +1,809 @@
+#include "jit.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT_X86_64 0
+#endif
+
+namespace {
+
+// The generated code gets the Chip8 in rdi and keeps a copy in rbx, which
+// is the only register it saves, so that it survives calls to the handlers.
+// Other than that it only uses eax, ecx and edx, and esi for arguments.
+enum Reg : uint8_t {
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    ESI = 6,
+};
+
+// x86 condition codes, the opposite of each is the one with the low bit flipped
+enum Cond : uint8_t {
+    CC_B = 0x2,  // unsigned <
+    CC_AE = 0x3, // unsigned >=
+    CC_E = 0x4,  // equal
+    CC_NE = 0x5, // not equal
+    CC_A = 0x7,  // unsigned >
+};
+
+// 32-bit ALU opcodes in their "op r/m32, r32" form
+enum Alu : uint8_t {
+    ALU_ADD = 0x01,
+    ALU_OR = 0x09,
+    ALU_AND = 0x21,
+    ALU_SUB = 0x29,
+    ALU_XOR = 0x31,
+    ALU_CMP = 0x39,
+    ALU_MOV = 0x89,
+};
+
+// Just enough of an x86-64 assembler for the instructions the JIT emits.
+// Memory operands are always [rdi + disp32], i.e. a field of the Chip8.
+class Emitter {
+public:
+    explicit Emitter(std::vector<uint8_t> &code) : code(code) {}
+
+    void byte(uint8_t b) {
+        code.push_back(b);
+    }
+
+    void imm16(uint16_t v) {
+        byte(v & 0xFF);
+        byte(v >> 8);
+    }
+
+    void imm32(uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            byte((v >> (8 * i)) & 0xFF);
+        }
+    }
+
+    // ModRM for [rdi + disp32] with the given reg field
+    void mem(uint8_t reg, int32_t offset) {
+        byte(0x80 | reg << 3 | 0x7);
+        imm32(offset);
+    }
+
+    // movzx r32, byte [rdi + offset]
+    void load8(Reg r, int32_t offset) {
+        byte(0x0F);
+        byte(0xB6);
+        mem(r, offset);
+    }
+
+    // movzx r32, word [rdi + offset]
+    void load16(Reg r, int32_t offset) {
+        byte(0x0F);
+        byte(0xB7);
+        mem(r, offset);
+    }
+
+    // movzx eax, byte [rdi + rax + offset]
+    void load8_indexed(int32_t offset) {
+        byte(0x0F);
+        byte(0xB6);
+        byte(0x84);
+        byte(0x07);
+        imm32(offset);
+    }
+
+    // mov byte [rdi + offset], r8
+    void store8(int32_t offset, Reg r) {
+        byte(0x88);
+        mem(r, offset);
+    }
+
+    // mov word [rdi + offset], r16
+    void store16(int32_t offset, Reg r) {
+        byte(0x66);
+        byte(0x89);
+        mem(r, offset);
+    }
+
+    // mov byte [rdi + offset], imm8
+    void store8_imm(int32_t offset, uint8_t v) {
+        byte(0xC6);
+        mem(0, offset);
+        byte(v);
+    }
+
+    // mov word [rdi + offset], imm16
+    void store16_imm(int32_t offset, uint16_t v) {
+        byte(0x66);
+        byte(0xC7);
+        mem(0, offset);
+        imm16(v);
+    }
+
+    // add byte [rdi + offset], imm8
+    void add8_imm(int32_t offset, uint8_t v) {
+        byte(0x80);
+        mem(0, offset);
+        byte(v);
+    }
+
+    // cmp byte [rdi + offset], imm8
+    void cmp8_imm(int32_t offset, uint8_t v) {
+        byte(0x80);
+        mem(7, offset);
+        byte(v);
+    }
+
+    // <op> dst, src
+    void alu(Alu op, Reg dst, Reg src) {
+        byte(op);
+        byte(0xC0 | src << 3 | dst);
+    }
+
+    // <op> r, imm32 for add (/0) and cmp (/7)
+    void alu_imm(uint8_t ext, Reg r, uint32_t v) {
+        byte(0x81);
+        byte(0xC0 | ext << 3 | r);
+        imm32(v);
+    }
+
+    // <op> r, imm8 for and (/4) and sub (/5), sign extended
+    void alu_imm8(uint8_t ext, Reg r, uint8_t v) {
+        byte(0x83);
+        byte(0xC0 | ext << 3 | r);
+        byte(v);
+    }
+
+    // shl (/4) or shr (/5) r, imm8
+    void shift(uint8_t ext, Reg r, uint8_t n) {
+        byte(0xC1);
+        byte(0xC0 | ext << 3 | r);
+        byte(n);
+    }
+
+    // test a, b
+    void test(Reg a, Reg b) {
+        byte(0x85);
+        byte(0xC0 | b << 3 | a);
+    }
+
+    // setcc r8
+    void setcc(Cond cc, Reg r) {
+        byte(0x0F);
+        byte(0x90 | cc);
+        byte(0xC0 | r);
+    }
+
+    // cmovcc dst, src
+    void cmov(Cond cc, Reg dst, Reg src) {
+        byte(0x0F);
+        byte(0x40 | cc);
+        byte(0xC0 | dst << 3 | src);
+    }
+
+    // mov r32, imm32
+    void mov_imm(Reg r, uint32_t v) {
+        byte(0xB8 | r);
+        imm32(v);
+    }
+
+    // lea eax, [rax + rax * 4]
+    void times5_eax() {
+        byte(0x8D);
+        byte(0x04);
+        byte(0x80);
+    }
+
+    // mov r64, imm64
+    void mov_imm64(Reg r, uint64_t v) {
+        byte(0x48);
+        byte(0xB8 | r);
+        imm32(v & 0xFFFFFFFF);
+        imm32(v >> 32);
+    }
+
+    // sub dword [rdi + offset], imm32
+    void sub32_imm(int32_t offset, uint32_t v) {
+        byte(0x81);
+        mem(5, offset);
+        imm32(v);
+    }
+
+    // add dword [rdi + offset], imm32
+    void add32_imm(int32_t offset, uint32_t v) {
+        byte(0x81);
+        mem(0, offset);
+        imm32(v);
+    }
+
+    // cmp dword [rdi + offset], imm32
+    void cmp32_imm(int32_t offset, uint32_t v) {
+        byte(0x81);
+        mem(7, offset);
+        imm32(v);
+    }
+
+    // test al, al
+    void test_al() {
+        byte(0x84);
+        byte(0xC0);
+    }
+
+    // push rbx, mov rbx, rdi
+    void enter() {
+        byte(0x53);
+        byte(0x48);
+        byte(0x89);
+        byte(0xFB);
+    }
+
+    // mov rdi, rbx after a call
+    void restore_rdi() {
+        byte(0x48);
+        byte(0x89);
+        byte(0xDF);
+    }
+
+    // call rax
+    void call_rax() {
+        byte(0xFF);
+        byte(0xD0);
+    }
+
+    // pop rbx, ret
+    void leave() {
+        byte(0x5B);
+        byte(0xC3);
+    }
+
+    // jcc rel32 and jmp rel32, going nowhere until bound. Returns where the
+    // displacement is.
+    size_t jcc(Cond cc) {
+        byte(0x0F);
+        byte(0x80 | cc);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    size_t jmp() {
+        byte(0xE9);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    // Point a jump at the code emitted next
+    void bind(size_t displacement) {
+        int32_t rel = static_cast<int32_t>(code.size() - (displacement + 4));
+        memcpy(&code[displacement], &rel, sizeof(rel));
+    }
+
+    size_t size() const {
+        return code.size();
+    }
+
+private:
+    std::vector<uint8_t> &code;
+};
+
+// Instructions that end a block with a handler deciding where it goes
+bool leaves_block(uint8_t op) {
+    switch (op) {
+        case OP_00EE:
+        case OP_Fx0A:
+        case OP_00FD:
+        case OP_F000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Instructions whose handler can write over code, and so drop the block
+bool writes_memory(uint8_t op) {
+    return op == OP_Fx33 || op == OP_Fx55 || op == OP_5xy2;
+}
+
+#if JIT_X86_64
+
+// The range every machine's code is placed in, reserved (but not backed by
+// memory) by the first machine that compiles something
+const size_t JIT_ARENA_SIZE = size_t(1) << 30;
+
+struct Arena {
+    std::mutex mutex;
+    uint8_t *base{};
+    size_t next{};
+    std::vector<uint8_t *> released;
+
+    Arena() {
+        void *memory = mmap(nullptr, JIT_ARENA_SIZE, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory != MAP_FAILED) {
+            base = static_cast<uint8_t *>(memory);
+        }
+    }
+
+    uint8_t *take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!released.empty()) {
+            uint8_t *chunk = released.back();
+            released.pop_back();
+            return chunk;
+        }
+        if (base == nullptr || next + JIT_CHUNK_SIZE > JIT_ARENA_SIZE) {
+            return nullptr;
+        }
+        uint8_t *chunk = base + next;
+        if (mprotect(chunk, JIT_CHUNK_SIZE, PROT_READ | PROT_EXEC) != 0) {
+            return nullptr;
+        }
+        next += JIT_CHUNK_SIZE;
+        return chunk;
+    }
+
+    void give_back(uint8_t *chunk) {
+        // the pages go back to the system until the chunk is used again
+        madvise(chunk, JIT_CHUNK_SIZE, MADV_DONTNEED);
+        std::lock_guard<std::mutex> lock(mutex);
+        released.push_back(chunk);
+    }
+};
+
+Arena &arena() {
+    static Arena shared;
+    return shared;
+}
+
+// Make the pages holding [at, at + size) writable for as long as it takes to
+// write there, only those pages so the rest of the code stays executable
+template <typename Write>
+void write_code(uint8_t *at, size_t size, Write write) {
+    static const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = reinterpret_cast<uintptr_t>(at) & ~(page - 1);
+    uintptr_t last = (reinterpret_cast<uintptr_t>(at) + size + page - 1) & ~(page - 1);
+    void *pages = reinterpret_cast<void *>(first);
+    mprotect(pages, last - first, PROT_READ | PROT_WRITE);
+    write();
+    mprotect(pages, last - first, PROT_READ | PROT_EXEC);
+    __builtin___clear_cache(reinterpret_cast<char *>(at), reinterpret_cast<char *>(at + size));
+}
+
+// Point the jump whose displacement is at `at` to target, or back at the
+// code right after it when target is nullptr
+void patch(uint8_t *at, const uint8_t *target) {
+    int32_t rel = target != nullptr ? static_cast<int32_t>(target - (at + 4)) : 0;
+    write_code(at, sizeof(rel), [&] {
+        memcpy(at, &rel, sizeof(rel));
+    });
+}
+
+#endif
+
+}
+
+Jit::Jit() = default;
+
+Jit::~Jit() {
+#if JIT_X86_64
+    for (uint8_t *chunk : chunks) {
+        arena().give_back(chunk);
+    }
+#endif
+}
+
+bool Jit::supported() const {
+#if JIT_X86_64
+    return arena().base != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool Jit::full() const {
+    return exhausted;
+}
+
+void Jit::clear() {
+#if JIT_X86_64
+    // keep one chunk to start over in
+    while (chunks.size() > 1) {
+        arena().give_back(chunks.back());
+        chunks.pop_back();
+    }
+#endif
+    used = 0;
+    exhausted = false;
+    entries.clear();
+    exits.clear();
+}
+
+uint8_t *Jit::allocate(size_t size) {
+#if JIT_X86_64
+    if (chunks.empty() || used + size > JIT_CHUNK_SIZE) {
+        uint8_t *chunk = size <= JIT_CHUNK_SIZE && (chunks.size() + 1) * JIT_CHUNK_SIZE <= JIT_BUFFER_SIZE
+                         ? arena().take() : nullptr;
+        if (chunk == nullptr) {
+            exhausted = true;
+            return nullptr;
+        }
+        chunks.push_back(chunk);
+        used = 0;
+    }
+
+    // keep every block 16-byte aligned
+    uint8_t *at = chunks.back() + used;
+    used += (size + 15) & ~static_cast<size_t>(15);
+    return at;
+#else
+    (void) size;
+    return nullptr;
+#endif
+}
+
+void Jit::unlink(uint16_t address) {
+#if JIT_X86_64
+    if (entries.empty() || entries[address] == nullptr) {
+        return;
+    }
+    entries[address] = nullptr;
+    for (uint8_t *exit : exits[address]) {
+        patch(exit, nullptr);
+    }
+#else
+    (void) address;
+#endif
+}
+
+bool Jit::run_handler(Chip8 *chip8, uint64_t instruction, uint32_t address) {
+    Instruction in;
+    memcpy(&in, &instruction, sizeof(in));
+    chip8->execute(in);
+    return chip8->blocks[address].valid;
+}
+
+static_assert(sizeof(Instruction) == sizeof(uint64_t), "instructions are passed to run_handler in a register");
+
+JitCode Jit::compile(const Chip8 &chip8, const Instruction *ops, unsigned int count,
+                     uint16_t address, bool linkable) {
+    if (!supported() || count == 0) {
+        return nullptr;
+    }
+
+#if JIT_X86_64
+    // where the machine state lives relative to the Chip8 passed in rdi
+    auto offset = [&chip8](const void *field) {
+        return static_cast<int32_t>(static_cast<const uint8_t *>(field) -
+                                    reinterpret_cast<const uint8_t *>(&chip8));
+    };
+    const int32_t registers = offset(chip8.registers);
+    const int32_t index = offset(&chip8.index);
+    const int32_t pc_field = offset(&chip8.pc);
+    const int32_t delay_timer = offset(&chip8.delay_timer);
+    const int32_t sound_timer = offset(&chip8.sound_timer);
+    const int32_t keypad = offset(chip8.keypad);
+    const int32_t budget = offset(&chip8.jit_budget);
+    const int32_t VF = registers + 0xF;
+    const QuirkSet &quirks = quirk_set(chip8.quirk_profile);
+
+    std::vector<uint8_t> code;
+    Emitter e(code);
+
+    // The jumps out of the block to a known address, and where they go. Each
+    // is followed by the code that leaves for the run loop instead, which is
+    // where it goes until it's linked to the block there.
+    std::vector<std::pair<size_t, uint16_t>> links;
+
+    // Take the cycles run off the budget and go on to target
+    auto exit_to = [&](uint16_t target, unsigned int ran) {
+        e.sub32_imm(budget, ran);
+        if (target < CODE_SIZE) {
+            links.emplace_back(e.jmp(), target);
+        }
+        e.store16_imm(pc_field, target);
+        e.leave();
+    };
+
+    // The same for when pc has already been set
+    auto exit_set = [&](unsigned int ran) {
+        e.sub32_imm(budget, ran);
+        e.leave();
+    };
+
+    // Blocks are linked into here, with the caller's frame. A block only
+    // runs when the budget covers all of it, i.e. every op but a skipped one.
+    e.enter();
+    const size_t inner = e.size();
+    e.cmp32_imm(budget, count);
+    const size_t bail = e.jcc(CC_B);
+
+    // where a taken skip carries on, after the op following it
+    std::vector<size_t> resume(count + 1, SIZE_MAX);
+
+    uint16_t pc = address;
+    bool falls_through = true;
+    for (unsigned int i = 0; i < count; i++) {
+        const Instruction &in = ops[i];
+        const int32_t Vx = registers + in.x;
+        const int32_t Vy = registers + in.y;
+        const unsigned int ran = i + 1;
+        pc += 2;
+
+        // a skip steps over a whole XO-CHIP F000 NNNN, the block is dropped
+        // if the instruction after it changes
+        const uint16_t skipped = pc + chip8.instruction_length(pc);
+
+        // Skip if cc: a skip over the next op of the block jumps past its
+        // code, it's only left for the run loop at the end of the block or
+        // over an F000 NNNN
+        auto skip = [&](Cond cc) {
+            const size_t run_next = e.jcc(static_cast<Cond>(cc ^ 1));
+            if (i + 1 < count && skipped == pc + 2) {
+                // the op skipped over doesn't count
+                e.add32_imm(budget, 1);
+                resume[i + 2] = e.jmp();
+            } else {
+                exit_to(skipped, ran);
+            }
+            e.bind(run_next);
+        };
+
+        // Each instruction is emitted as the same sequence of loads and
+        // stores as its handler in chip8.cpp, so that overlapping registers
+        // (e.g. x or y being F) come out exactly the same.
+        switch (in.op) {
+            case OP_1nnn:
+                exit_to(in.nnn, ran);
+                falls_through = false;
+                break;
+            case OP_3xkk:
+                e.cmp8_imm(Vx, in.kk);
+                skip(CC_E);
+                break;
+            case OP_4xkk:
+                e.cmp8_imm(Vx, in.kk);
+                skip(CC_NE);
+                break;
+            case OP_5xy0:
+            case OP_9xy0:
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_CMP, EAX, ECX);
+                skip(in.op == OP_5xy0 ? CC_E : CC_NE);
+                break;
+            case OP_6xkk:
+                e.store8_imm(Vx, in.kk);
+                break;
+            case OP_7xkk:
+                e.add8_imm(Vx, in.kk);
+                break;
+            case OP_8xy0:
+                e.load8(EAX, Vy);
+                e.store8(Vx, EAX);
+                break;
+            case OP_8xy1:
+            case OP_8xy2:
+            case OP_8xy3:
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(in.op == OP_8xy1 ? ALU_OR : in.op == OP_8xy2 ? ALU_AND : ALU_XOR, EAX, ECX);
+                e.store8(Vx, EAX);
+                if (quirks.vf_reset) {
+                    e.store8_imm(VF, 0);
+                }
+                break;
+            case OP_8xy4:
+                // VF = carry, Vx = low byte of the sum
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_ADD, EAX, ECX);
+                e.alu(ALU_MOV, EDX, EAX);
+                e.shift(5, EDX, 8);
+                if (quirks.flag_last) {
+                    e.store8(Vx, EAX);
+                    e.store8(VF, EDX);
+                } else {
+                    e.store8(VF, EDX);
+                    e.store8(Vx, EAX);
+                }
+                break;
+            case OP_8xy5:
+                // VF = Vx >= Vy, then Vx -= Vy
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_CMP, EAX, ECX);
+                e.setcc(CC_AE, EDX);
+                if (quirks.flag_last) {
+                    e.alu(ALU_SUB, EAX, ECX);
+                    e.store8(Vx, EAX);
+                    e.store8(VF, EDX);
+                    break;
+                }
+                e.store8(VF, EDX);
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_SUB, EAX, ECX);
+                e.store8(Vx, EAX);
+                break;
+            case OP_8xy6:
+                // VF = Vx & 1, then Vx >>= 1 (or Vy with the VIP quirks)
+                if (quirks.flag_last) {
+                    e.load8(EAX, quirks.shift_vy ? Vy : Vx);
+                    e.alu(ALU_MOV, EDX, EAX);
+                    e.alu_imm8(4, EDX, 1);
+                    e.shift(5, EAX, 1);
+                    e.store8(Vx, EAX);
+                    e.store8(VF, EDX);
+                    break;
+                }
+                e.load8(EDX, quirks.shift_vy ? Vy : Vx);
+                e.alu_imm8(4, EDX, 1);
+                e.store8(VF, EDX);
+                e.load8(EAX, quirks.shift_vy ? Vy : Vx);
+                e.shift(5, EAX, 1);
+                e.store8(Vx, EAX);
+                break;
+            case OP_8xy7:
+                // VF = Vy > Vx, then Vx = Vy - Vx
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_CMP, ECX, EAX);
+                e.setcc(CC_A, EDX);
+                if (quirks.flag_last) {
+                    e.alu(ALU_SUB, ECX, EAX);
+                    e.store8(Vx, ECX);
+                    e.store8(VF, EDX);
+                    break;
+                }
+                e.store8(VF, EDX);
+                e.load8(EAX, Vx);
+                e.load8(ECX, Vy);
+                e.alu(ALU_SUB, ECX, EAX);
+                e.store8(Vx, ECX);
+                break;
+            case OP_8xyE:
+                // VF = Vx >> 7, then Vx <<= 1 (or Vy with the VIP quirks)
+                if (quirks.flag_last) {
+                    e.load8(EAX, quirks.shift_vy ? Vy : Vx);
+                    e.alu(ALU_MOV, EDX, EAX);
+                    e.shift(5, EDX, 7);
+                    e.shift(4, EAX, 1);
+                    e.store8(Vx, EAX);
+                    e.store8(VF, EDX);
+                    break;
+                }
+                e.load8(EDX, quirks.shift_vy ? Vy : Vx);
+                e.shift(5, EDX, 7);
+                e.store8(VF, EDX);
+                e.load8(EAX, quirks.shift_vy ? Vy : Vx);
+                e.shift(4, EAX, 1);
+                e.store8(Vx, EAX);
+                break;
+            case OP_Annn:
+                e.store16_imm(index, in.nnn);
+                break;
+            case OP_Bnnn:
+                e.load8(EAX, quirks.jump_vx ? Vx : registers);
+                e.alu_imm(0, EAX, in.nnn);
+                e.store16(pc_field, EAX);
+                exit_set(ran);
+                falls_through = false;
+                break;
+            case OP_Ex9E:
+            case OP_ExA1:
+                // keys past F are never pressed: the index is pointed at
+                // key 0 and what's read is replaced with 0, neither of
+                // which touches the flags from the compare
+                e.load8(EAX, Vx);
+                e.mov_imm(ECX, 0);
+                e.alu_imm(7, EAX, KEY_COUNT);
+                e.cmov(CC_AE, EAX, ECX);
+                e.load8_indexed(keypad);
+                e.cmov(CC_AE, EAX, ECX);
+                e.test(EAX, EAX);
+                skip(in.op == OP_Ex9E ? CC_NE : CC_E);
+                break;
+            case OP_Fx07:
+                e.load8(EAX, delay_timer);
+                e.store8(Vx, EAX);
+                break;
+            case OP_Fx15:
+            case OP_Fx18:
+                e.load8(EAX, Vx);
+                e.store8(in.op == OP_Fx15 ? delay_timer : sound_timer, EAX);
+                break;
+            case OP_Fx1E:
+                // VF = I + Vx > 0xFFF, then I += Vx
+                e.load16(EAX, index);
+                e.load8(ECX, Vx);
+                e.alu(ALU_ADD, EAX, ECX);
+                e.alu_imm(7, EAX, 0xFFF);
+                e.setcc(CC_A, EDX);
+                e.store8(VF, EDX);
+                e.load16(EAX, index);
+                e.load8(ECX, Vx);
+                e.alu(ALU_ADD, EAX, ECX);
+                e.store16(index, EAX);
+                break;
+            case OP_Fx29:
+                e.load8(EAX, Vx);
+                e.times5_eax();
+                e.store16(index, EAX);
+                break;
+            default: {
+                // everything else is left to its handler, which may look at
+                // pc, e.g. 2nnn pushes it
+                uint64_t packed;
+                memcpy(&packed, &in, sizeof(packed));
+                e.store16_imm(pc_field, pc);
+                e.mov_imm64(ESI, packed);
+                e.mov_imm(EDX, address);
+                e.mov_imm64(EAX, reinterpret_cast<uint64_t>(&Jit::run_handler));
+                e.call_rax();
+                e.restore_rdi();
+                if (in.op == OP_2nnn) {
+                    exit_to(in.nnn, ran);
+                    falls_through = false;
+                } else if (leaves_block(in.op)) {
+                    exit_set(ran);
+                    falls_through = false;
+                } else if (writes_memory(in.op)) {
+                    // stop if it wrote over this block
+                    e.test_al();
+                    const size_t valid = e.jcc(CC_NE);
+                    exit_set(ran);
+                    e.bind(valid);
+                }
+            }
+        }
+
+        if (resume[i + 1] != SIZE_MAX) {
+            e.bind(resume[i + 1]);
+            falls_through = true;
+        }
+    }
+
+    if (falls_through) {
+        exit_to(pc, count);
+    }
+
+    // not enough cycles left to run the whole block
+    e.bind(bail);
+    e.store16_imm(pc_field, address);
+    e.leave();
+
+    uint8_t *target = allocate(code.size());
+    if (target == nullptr) {
+        return nullptr;
+    }
+    write_code(target, code.size(), [&] {
+        memcpy(target, code.data(), code.size());
+    });
+
+    // link up with the blocks that are already compiled, both ways
+    if (entries.empty()) {
+        entries.assign(CODE_SIZE, nullptr);
+        exits.resize(CODE_SIZE);
+    }
+    for (const auto &link : links) {
+        uint8_t *exit = target + link.first;
+        exits[link.second].push_back(exit);
+        if (entries[link.second] != nullptr) {
+            patch(exit, entries[link.second]);
+        }
+    }
+    if (linkable) {
+        entries[address] = target + inner;
+        for (uint8_t *exit : exits[address]) {
+            patch(exit, entries[address]);
+        }
+    }
+    return reinterpret_cast<JitCode>(target);
+#else
+    (void) chip8;
+    (void) ops;
+    (void) address;
+    (void) linkable;
+    return nullptr;
+#endif
+}
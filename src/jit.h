@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// Most executable memory each machine compiles its blocks into
+const size_t JIT_BUFFER_SIZE = 256 * 1024;
+
+// Machines get that memory a chunk at a time, out of a range reserved once
+// for the whole process, so a machine only takes what it uses and no two
+// machines ever share a page
+const size_t JIT_CHUNK_SIZE = 64 * 1024;
+
+// Number of times a block has to run before it's compiled
+const unsigned int JIT_THRESHOLD = 8;
+
+// Compiles blocks of decoded instructions into x86-64 machine code. The code
+// (a JitCode) runs straight against the registers, index, pc and timers of
+// the Chip8 it's given, so the machine itself is the pinned context.
+//
+// A whole block is compiled. Instructions the JIT doesn't generate code for
+// (Dxyn, Fx0A, the stack, memory writes, ...) call their handler. A block
+// whose next address is known when it's compiled jumps straight into the
+// code for the block there once that's compiled too, so the code keeps
+// running from block to block until it runs out of cycles (Chip8's
+// jit_budget) or gets to a return, a computed jump or a block it isn't
+// linked to.
+class Jit {
+public:
+    Jit();
+    ~Jit();
+
+    // Whether native code can be generated and run on this host
+    bool supported() const;
+
+    // Compile the block of count instructions starting at address. Other
+    // blocks jump into it only when it's linkable. Returns nullptr when the
+    // buffer is full.
+    JitCode compile(const Chip8 &chip8, const Instruction *ops, unsigned int count,
+                    uint16_t address, bool linkable);
+
+    // Stop jumping into the code for the block at address, it's no longer valid
+    void unlink(uint16_t address);
+
+    // Throw away all compiled code
+    void clear();
+
+    bool full() const;
+
+private:
+    std::vector<uint8_t *> chunks; // from the shared range, the last one is being filled
+    size_t used{};                 // bytes used in the last chunk
+    bool exhausted{};
+
+    // Where blocks linked to from other blocks start, and the jumps to each
+    // block's address, both indexed by address
+    std::vector<uint8_t *> entries;
+    std::vector<std::vector<uint8_t *>> exits;
+
+    uint8_t *allocate(size_t size);
+
+    // Run the handler for an instruction the JIT doesn't generate code for,
+    // returns whether the block at address is still valid after it
+    static bool run_handler(Chip8 *chip8, uint64_t instruction, uint32_t address);
+};
@@ -0,0 +1,611 @@
+#include "lockstep.h"
+#include <cstring>
+#include <iostream>
+
+const uint8_t VF = 0xF;
+
+// Memory is wrapped per machine so that a stray index can never reach into
+// the next machine's memory
+const unsigned int ADDRESS_MASK = MEMORY_SIZE - 1;
+
+Lockstep::Lockstep(unsigned int machines, Quirks profile)
+        : machines(machines),
+          quirks(quirk_set(profile)),
+          tiles((machines + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES),
+          memory(machines * MEMORY_SIZE, 0),
+          displays(machines),
+          keys(machines * KEY_COUNT, 0),
+          flags(machines * FLAG_COUNT, 0),
+          patterns(machines * AUDIO_PATTERN_SIZE, 0),
+          rand_gen(machines) {
+    for (Tile &tile : tiles) {
+        for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+            tile.pc[i] = START_ADDRESS;
+            tile.plane_mask[i] = 1;
+            tile.pitch[i] = DEFAULT_PITCH;
+        }
+    }
+
+    // load fonts into every machine's memory
+    for (unsigned int machine = 0; machine < machines; machine++) {
+        memcpy(&memory[machine * MEMORY_SIZE], fontset, FONTSET_SIZE);
+        memcpy(&memory[machine * MEMORY_SIZE + FONTSET_SIZE], bigfont, BIGFONT_SIZE);
+    }
+}
+
+bool Lockstep::load_rom(const uint8_t *data, size_t size) {
+    if (size > MAX_ROM_SIZE) {
+        std::cerr << "ROM is too large (" << size << " bytes)" << std::endl;
+        return false;
+    }
+
+    for (unsigned int machine = 0; machine < machines; machine++) {
+        memcpy(&memory[machine * MEMORY_SIZE + START_ADDRESS], data, size);
+    }
+    return true;
+}
+
+void Lockstep::seed(unsigned int machine, uint64_t value) {
+    rand_gen[machine].seed(value);
+}
+
+unsigned int Lockstep::size() const {
+    return machines;
+}
+
+const Display &Lockstep::display(unsigned int machine) const {
+    return displays[machine];
+}
+
+uint8_t *Lockstep::keypad(unsigned int machine) {
+    return &keys[machine * KEY_COUNT];
+}
+
+// Same layout as Chip8::hash
+uint64_t Lockstep::hash(unsigned int machine) const {
+    const Tile &tile = tiles[machine / LOCKSTEP_LANES];
+    unsigned int lane = machine % LOCKSTEP_LANES;
+
+    uint8_t registers[REGISTER_COUNT];
+    for (unsigned int r = 0; r < REGISTER_COUNT; r++) {
+        registers[r] = tile.registers[r][lane];
+    }
+    uint16_t stack[STACK_LEVELS];
+    for (unsigned int level = 0; level < STACK_LEVELS; level++) {
+        stack[level] = tile.stack[level][lane];
+    }
+
+    uint64_t hash = HASH_SEED;
+    hash = hash_bytes(hash, &memory[machine * MEMORY_SIZE], MEMORY_SIZE);
+    hash = hash_bytes(hash, registers, sizeof(registers));
+    hash = hash_bytes(hash, &tile.index[lane], sizeof(uint16_t));
+    hash = hash_bytes(hash, &tile.pc[lane], sizeof(uint16_t));
+    hash = hash_bytes(hash, stack, sizeof(stack));
+    hash = hash_bytes(hash, &tile.sp[lane], sizeof(uint8_t));
+    hash = hash_bytes(hash, &tile.delay_timer[lane], sizeof(uint8_t));
+    hash = hash_bytes(hash, &tile.sound_timer[lane], sizeof(uint8_t));
+    hash = hash_bytes(hash, displays[machine].planes, sizeof(Display::planes));
+    hash = hash_bytes(hash, &displays[machine].hires, sizeof(bool));
+    hash = hash_bytes(hash, &tile.plane_mask[lane], sizeof(uint8_t));
+    hash = hash_bytes(hash, &flags[machine * FLAG_COUNT], FLAG_COUNT);
+    hash = hash_bytes(hash, &patterns[machine * AUDIO_PATTERN_SIZE], AUDIO_PATTERN_SIZE);
+    hash = hash_bytes(hash, &tile.pitch[lane], sizeof(uint8_t));
+    bool crashed = tile.crashed[lane] != 0;
+    hash = hash_bytes(hash, &crashed, sizeof(bool));
+    return hash;
+}
+
+bool Lockstep::crashed(unsigned int machine) const {
+    return tiles[machine / LOCKSTEP_LANES].crashed[machine % LOCKSTEP_LANES] != 0;
+}
+
+uint16_t Lockstep::next_address(unsigned int machine) const {
+    return tiles[machine / LOCKSTEP_LANES].pc[machine % LOCKSTEP_LANES];
+}
+
+uint16_t Lockstep::next_opcode(unsigned int machine) const {
+    const uint8_t *code = &memory[machine * MEMORY_SIZE];
+    uint16_t pc = next_address(machine);
+    return code[pc & ADDRESS_MASK] << 8 | code[(pc + 1) & ADDRESS_MASK];
+}
+
+void Lockstep::run(unsigned int cycles) {
+    for (unsigned int tile = 0; tile < tiles.size(); tile++) {
+        run_tile(tile, cycles);
+    }
+}
+
+void Lockstep::run_frame(unsigned int cycles) {
+    run(cycles);
+    tick_timers();
+}
+
+// Count every machine's timers down, once per 60 Hz frame
+void Lockstep::tick_timers() {
+    for (Tile &tile : tiles) {
+        // a machine that has stopped keeps its timers where they were
+        for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+            uint8_t live = tile.crashed[i] ? 0 : 1;
+            tile.delay_timer[i] -= tile.delay_timer[i] > 0 ? live : 0;
+            tile.sound_timer[i] -= tile.sound_timer[i] > 0 ? live : 0;
+        }
+    }
+}
+
+void Lockstep::run_tile(unsigned int index, unsigned int cycles) {
+    Tile &tile = tiles[index];
+    unsigned int first = index * LOCKSTEP_LANES;
+    for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+        tile.remaining[i] = first + i < machines && !tile.crashed[i] ? cycles : 0;
+    }
+
+    while (step(tile, first)) {
+    }
+}
+
+// Execute the next instruction of the lane that's furthest behind, together
+// with every other lane that's about to run the same instruction at the same
+// address. Returns false once every lane has run all of its cycles.
+bool Lockstep::step(Tile &tile, unsigned int first) {
+    unsigned int leader = LOCKSTEP_LANES;
+    uint32_t most = 0;
+    for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+        if (tile.remaining[i] > most) {
+            most = tile.remaining[i];
+            leader = i;
+        }
+    }
+    if (leader == LOCKSTEP_LANES) {
+        return false;
+    }
+
+    // fetch the operation
+    uint16_t address = tile.pc[leader];
+    const uint8_t *code = &memory[(first + leader) * MEMORY_SIZE];
+    uint8_t high = code[address & ADDRESS_MASK];
+    uint8_t low = code[(address + 1) & ADDRESS_MASK];
+
+    // lanes only run along if their own memory holds the same instruction
+    for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+        bool same = tile.remaining[i] > 0 && tile.pc[i] == address;
+        if (same && i != leader) {
+            const uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+            same = lane[address & ADDRESS_MASK] == high && lane[(address + 1) & ADDRESS_MASK] == low;
+        }
+        tile.mask[i] = same ? 0xFF : 0;
+    }
+
+    uint16_t opcode = high << 8 | low;
+    execute(tile, first, decode_table[opcode], opcode);
+
+    // count the instruction for every lane that ran it, lanes that stopped
+    // at it have nothing left to run
+    for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+        tile.remaining[i] = tile.crashed[i] ? 0 : tile.remaining[i] - (tile.mask[i] & 1);
+    }
+    return true;
+}
+
+// Execute one instruction on the masked lanes of a tile. Register and timer
+// instructions are written as branch-free selects over all lanes so they
+// vectorize; those touching each machine's memory, video, keypad or RNG are
+// run lane by lane. Every lane follows the exact order of reads and writes
+// of the matching handler in chip8.cpp.
+// 8xy1, 8xy2 and 8xy3 clear VF with the VIP quirks
+void Lockstep::reset_flag(uint8_t *flag, const uint8_t *m) const {
+    if (quirks.vf_reset) {
+        for (unsigned int i = 0; i < LOCKSTEP_LANES; i++) {
+            flag[i] &= ~m[i];
+        }
+    }
+}
+
+// Skips step over both halves of XO-CHIP's four byte F000 NNNN
+uint16_t Lockstep::skip_length(unsigned int machine, uint16_t pc) const {
+    const uint8_t *lane = &memory[machine * MEMORY_SIZE];
+    return lane[pc & ADDRESS_MASK] == 0xF0 && lane[(pc + 1) & ADDRESS_MASK] == 0x00 ? 4 : 2;
+}
+
+void Lockstep::execute(Tile &tile, unsigned int first, const Instruction &in, uint16_t opcode) {
+    const uint8_t *m = tile.mask;
+    uint8_t *Vx = tile.registers[in.x];
+    uint8_t *Vy = tile.registers[in.y];
+    uint8_t *flag = tile.registers[VF];
+    const uint8_t *Vs = quirks.shift_vy ? Vy : Vx; // what 8xy6 and 8xyE shift
+    uint16_t *pc = tile.pc;
+    uint16_t *index = tile.index;
+    const unsigned int L = LOCKSTEP_LANES;
+
+    for (unsigned int i = 0; i < L; i++) {
+        pc[i] += m[i] & 2;
+    }
+
+    switch (in.op) {
+        case OP_00E0:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    displays[first + i].clear(tile.plane_mask[i]);
+                }
+            }
+            break;
+        case OP_00EE:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    --tile.sp[i];
+                    pc[i] = tile.stack[tile.sp[i] % STACK_LEVELS][i];
+                }
+            }
+            break;
+        case OP_1nnn:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] = m[i] ? in.nnn : pc[i];
+            }
+            break;
+        case OP_2nnn:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    tile.stack[tile.sp[i] % STACK_LEVELS][i] = pc[i];
+                    ++tile.sp[i];
+                    pc[i] = in.nnn;
+                }
+            }
+            break;
+        case OP_3xkk:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] += m[i] && Vx[i] == in.kk ? skip_length(first + i, pc[i]) : 0;
+            }
+            break;
+        case OP_4xkk:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] += m[i] && Vx[i] != in.kk ? skip_length(first + i, pc[i]) : 0;
+            }
+            break;
+        case OP_5xy0:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] += m[i] && Vx[i] == Vy[i] ? skip_length(first + i, pc[i]) : 0;
+            }
+            break;
+        case OP_6xkk:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] = m[i] ? in.kk : Vx[i];
+            }
+            break;
+        case OP_7xkk:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] += m[i] & in.kk;
+            }
+            break;
+        case OP_8xy0:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] = m[i] ? Vy[i] : Vx[i];
+            }
+            break;
+        case OP_8xy1:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] |= m[i] & Vy[i];
+            }
+            reset_flag(flag, m);
+            break;
+        case OP_8xy2:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] &= ~m[i] | Vy[i];
+            }
+            reset_flag(flag, m);
+            break;
+        case OP_8xy3:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] ^= m[i] & Vy[i];
+            }
+            reset_flag(flag, m);
+            break;
+        case OP_8xy4:
+            if (quirks.flag_last) {
+                for (unsigned int i = 0; i < L; i++) {
+                    uint16_t sum = Vx[i] + Vy[i];
+                    Vx[i] = m[i] ? sum & 0xFFu : Vx[i];
+                    flag[i] = m[i] ? (sum > 255 ? 1 : 0) : flag[i];
+                }
+                break;
+            }
+            for (unsigned int i = 0; i < L; i++) {
+                uint16_t sum = Vx[i] + Vy[i];
+                flag[i] = m[i] ? (sum > 255 ? 1 : 0) : flag[i];
+                Vx[i] = m[i] ? sum & 0xFFu : Vx[i];
+            }
+            break;
+        case OP_8xy5:
+            if (quirks.flag_last) {
+                for (unsigned int i = 0; i < L; i++) {
+                    uint8_t result = Vy[i] > Vx[i] ? 0 : 1;
+                    Vx[i] -= m[i] & Vy[i];
+                    flag[i] = m[i] ? result : flag[i];
+                }
+                break;
+            }
+            for (unsigned int i = 0; i < L; i++) {
+                flag[i] = m[i] ? (Vy[i] > Vx[i] ? 0 : 1) : flag[i];
+                Vx[i] -= m[i] & Vy[i];
+            }
+            break;
+        case OP_8xy6:
+            if (quirks.flag_last) {
+                for (unsigned int i = 0; i < L; i++) {
+                    uint8_t value = Vs[i];
+                    Vx[i] = m[i] ? value >> 1 : Vx[i];
+                    flag[i] = m[i] ? value & 0x1 : flag[i];
+                }
+                break;
+            }
+            for (unsigned int i = 0; i < L; i++) {
+                flag[i] = m[i] ? Vs[i] & 0x1 : flag[i];
+                Vx[i] = m[i] ? Vs[i] >> 1 : Vx[i];
+            }
+            break;
+        case OP_8xy7:
+            if (quirks.flag_last) {
+                for (unsigned int i = 0; i < L; i++) {
+                    uint8_t result = Vy[i] > Vx[i] ? 1 : 0;
+                    Vx[i] = m[i] ? Vy[i] - Vx[i] : Vx[i];
+                    flag[i] = m[i] ? result : flag[i];
+                }
+                break;
+            }
+            for (unsigned int i = 0; i < L; i++) {
+                flag[i] = m[i] ? (Vy[i] > Vx[i] ? 1 : 0) : flag[i];
+                Vx[i] = m[i] ? Vy[i] - Vx[i] : Vx[i];
+            }
+            break;
+        case OP_8xyE:
+            if (quirks.flag_last) {
+                for (unsigned int i = 0; i < L; i++) {
+                    uint8_t value = Vs[i];
+                    Vx[i] = m[i] ? value << 1 : Vx[i];
+                    flag[i] = m[i] ? (value & 0x80) >> 7 : flag[i];
+                }
+                break;
+            }
+            for (unsigned int i = 0; i < L; i++) {
+                flag[i] = m[i] ? (Vs[i] & 0x80) >> 7 : flag[i];
+                Vx[i] = m[i] ? Vs[i] << 1 : Vx[i];
+            }
+            break;
+        case OP_9xy0:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] += m[i] && Vx[i] != Vy[i] ? skip_length(first + i, pc[i]) : 0;
+            }
+            break;
+        case OP_Annn:
+            for (unsigned int i = 0; i < L; i++) {
+                index[i] = m[i] ? in.nnn : index[i];
+            }
+            break;
+        case OP_Bnnn:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] = m[i] ? tile.registers[quirks.jump_vx ? in.x : 0][i] + in.nnn : pc[i];
+            }
+            break;
+        case OP_Cxkk:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    Vx[i] = rand_gen[first + i].next_byte() & in.kk;
+                }
+            }
+            break;
+        case OP_Dxyn:
+            for (unsigned int i = 0; i < L; i++) {
+                if (!m[i]) {
+                    continue;
+                }
+                const uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                Display &display = displays[first + i];
+                uint64_t dirty = 0;
+                bool collision = quirks.wrap_sprites
+                                 ? display.draw<true>(tile.plane_mask[i], lane, index[i], Vx[i], Vy[i], in.n, dirty)
+                                 : display.draw<false>(tile.plane_mask[i], lane, index[i], Vx[i], Vy[i], in.n, dirty);
+                flag[i] = collision ? 1 : 0;
+            }
+            break;
+        case OP_Ex9E:
+        case OP_ExA1:
+            for (unsigned int i = 0; i < L; i++) {
+                // lanes past the last machine have no keys
+                bool pressed = m[i] && Vx[i] < KEY_COUNT && keys[(first + i) * KEY_COUNT + Vx[i]];
+                bool skip = in.op == OP_Ex9E ? pressed : !pressed;
+                pc[i] += m[i] && skip ? skip_length(first + i, pc[i]) : 0;
+            }
+            break;
+        case OP_Fx07:
+            for (unsigned int i = 0; i < L; i++) {
+                Vx[i] = m[i] ? tile.delay_timer[i] : Vx[i];
+            }
+            break;
+        case OP_Fx0A:
+            for (unsigned int i = 0; i < L; i++) {
+                if (!m[i]) {
+                    continue;
+                }
+                const uint8_t *lane = &keys[(first + i) * KEY_COUNT];
+                unsigned int key = 0;
+                while (key < KEY_COUNT && lane[key] == 0) {
+                    key++;
+                }
+                if (key < KEY_COUNT) {
+                    Vx[i] = key;
+                } else {
+                    pc[i] -= 2;
+                }
+            }
+            break;
+        case OP_Fx15:
+            for (unsigned int i = 0; i < L; i++) {
+                tile.delay_timer[i] = m[i] ? Vx[i] : tile.delay_timer[i];
+            }
+            break;
+        case OP_Fx18:
+            for (unsigned int i = 0; i < L; i++) {
+                tile.sound_timer[i] = m[i] ? Vx[i] : tile.sound_timer[i];
+            }
+            break;
+        case OP_Fx1E:
+            for (unsigned int i = 0; i < L; i++) {
+                flag[i] = m[i] ? (index[i] + Vx[i] > 0xFFF ? 1 : 0) : flag[i];
+                index[i] = m[i] ? index[i] + Vx[i] : index[i];
+            }
+            break;
+        case OP_Fx29:
+            for (unsigned int i = 0; i < L; i++) {
+                index[i] = m[i] ? 5 * Vx[i] : index[i];
+            }
+            break;
+        case OP_Fx33:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    uint8_t value = Vx[i];
+                    lane[(index[i] + 2) & ADDRESS_MASK] = value % 10;
+                    value /= 10;
+                    lane[(index[i] + 1) & ADDRESS_MASK] = value % 10;
+                    value /= 10;
+                    lane[index[i] & ADDRESS_MASK] = value % 10;
+                }
+            }
+            break;
+        case OP_Fx55:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    for (unsigned int r = 0; r <= in.x; r++) {
+                        lane[(index[i] + r) & ADDRESS_MASK] = tile.registers[r][i];
+                    }
+                    index[i] = index_after_load_store(quirks.load_store, index[i], in.x);
+                }
+            }
+            break;
+        case OP_Fx65:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    const uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    for (unsigned int r = 0; r <= in.x; r++) {
+                        tile.registers[r][i] = lane[(index[i] + r) & ADDRESS_MASK];
+                    }
+                    index[i] = index_after_load_store(quirks.load_store, index[i], in.x);
+                }
+            }
+            break;
+        case OP_00Cn:
+        case OP_00Dn:
+        case OP_00FB:
+        case OP_00FC:
+            for (unsigned int i = 0; i < L; i++) {
+                if (!m[i]) {
+                    continue;
+                }
+                Display &display = displays[first + i];
+                uint8_t mask = tile.plane_mask[i];
+                switch (in.op) {
+                    case OP_00Cn:
+                        display.scroll_down(mask, in.n);
+                        break;
+                    case OP_00Dn:
+                        display.scroll_up(mask, in.n);
+                        break;
+                    case OP_00FB:
+                        display.scroll_right(mask);
+                        break;
+                    default:
+                        display.scroll_left(mask);
+                        break;
+                }
+            }
+            break;
+        case OP_00FD:
+            for (unsigned int i = 0; i < L; i++) {
+                pc[i] -= m[i] & 2;
+            }
+            break;
+        case OP_00FE:
+        case OP_00FF:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    displays[first + i].set_hires(in.op == OP_00FF);
+                }
+            }
+            break;
+        case OP_Fx30:
+            for (unsigned int i = 0; i < L; i++) {
+                index[i] = m[i] ? FONTSET_SIZE + 10 * (Vx[i] & 0xFu) : index[i];
+            }
+            break;
+        case OP_Fx75:
+        case OP_Fx85:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    uint8_t *lane = &flags[(first + i) * FLAG_COUNT];
+                    for (unsigned int r = 0; r <= in.x; r++) {
+                        if (in.op == OP_Fx75) {
+                            lane[r] = tile.registers[r][i];
+                        } else {
+                            tile.registers[r][i] = lane[r];
+                        }
+                    }
+                }
+            }
+            break;
+        case OP_5xy2:
+        case OP_5xy3: {
+            int step = in.x <= in.y ? 1 : -1;
+            unsigned int count = (in.x <= in.y ? in.y - in.x : in.x - in.y) + 1;
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    for (unsigned int r = 0; r < count; r++) {
+                        uint8_t *reg = &tile.registers[in.x + step * static_cast<int>(r)][i];
+                        if (in.op == OP_5xy2) {
+                            lane[(index[i] + r) & ADDRESS_MASK] = *reg;
+                        } else {
+                            *reg = lane[(index[i] + r) & ADDRESS_MASK];
+                        }
+                    }
+                }
+            }
+            break;
+        }
+        case OP_F000:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    const uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    index[i] = lane[pc[i] & ADDRESS_MASK] << 8u | lane[(pc[i] + 1) & ADDRESS_MASK];
+                    pc[i] += 2;
+                }
+            }
+            break;
+        case OP_Fn01:
+            for (unsigned int i = 0; i < L; i++) {
+                tile.plane_mask[i] = m[i] ? in.x & ((1u << PLANE_COUNT) - 1) : tile.plane_mask[i];
+            }
+            break;
+        case OP_F002:
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    const uint8_t *lane = &memory[(first + i) * MEMORY_SIZE];
+                    for (unsigned int b = 0; b < AUDIO_PATTERN_SIZE; b++) {
+                        patterns[(first + i) * AUDIO_PATTERN_SIZE + b] = lane[(index[i] + b) & ADDRESS_MASK];
+                    }
+                }
+            }
+            break;
+        case OP_Fx3A:
+            for (unsigned int i = 0; i < L; i++) {
+                tile.pitch[i] = m[i] ? Vx[i] : tile.pitch[i];
+            }
+            break;
+        default:
+            // stop at the unknown opcode, only on the lanes that ran it
+            for (unsigned int i = 0; i < L; i++) {
+                if (m[i]) {
+                    pc[i] -= 2;
+                    tile.crashed[i] = 1;
+                }
+            }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// Machines per tile: one AVX2 register's worth of 8-bit lanes
+const unsigned int LOCKSTEP_LANES = 32;
+
+// Runs many copies of the same ROM side by side, e.g. with different seeds
+// or keypad input. The machines are grouped into tiles of LOCKSTEP_LANES
+// whose registers, index, pc, stack and timers are stored as arrays of
+// lanes, and each instruction is executed across every lane of the tile
+// that's at the same address, masking out the rest. Lanes that diverge are
+// stepped separately until they line up again. They aren't regrouped:
+// every step still loops over all LOCKSTEP_LANES lanes of the tile, several
+// times for most instructions, so a step costs about the same however many
+// lanes take part. Machines that stay together run up to LOCKSTEP_LANES
+// times faster than one by one, but a tile whose lanes have all gone their
+// own way does up to LOCKSTEP_LANES times the work.
+//
+// A machine that runs into an unknown opcode stops there, like a Chip8 does
+// (see Chip8::crashed), and the other lanes carry on.
+//
+// Every lane produces exactly the same state as a Chip8 with the same seed,
+// input and quirks (see Chip8::hash).
+class Lockstep {
+public:
+    explicit Lockstep(unsigned int machines, Quirks profile = Quirks::Legacy);
+
+    bool load_rom(const uint8_t *data, size_t size);
+    void seed(unsigned int machine, uint64_t value);
+
+    // Execute the given number of instructions on every machine
+    void run(unsigned int cycles);
+    void run_frame(unsigned int cycles);
+    void tick_timers();
+
+    unsigned int size() const;
+    uint64_t hash(unsigned int machine) const;
+    bool crashed(unsigned int machine) const;
+    uint16_t next_address(unsigned int machine) const;
+    uint16_t next_opcode(unsigned int machine) const;
+    const Display &display(unsigned int machine) const;
+    uint8_t *keypad(unsigned int machine);
+
+private:
+    // LOCKSTEP_LANES machines in structure-of-arrays form
+    struct Tile {
+        uint8_t registers[REGISTER_COUNT][LOCKSTEP_LANES]{};
+        uint16_t index[LOCKSTEP_LANES]{};
+        uint16_t pc[LOCKSTEP_LANES]{};
+        uint16_t stack[STACK_LEVELS][LOCKSTEP_LANES]{};
+        uint8_t sp[LOCKSTEP_LANES]{};
+        uint8_t delay_timer[LOCKSTEP_LANES]{};
+        uint8_t sound_timer[LOCKSTEP_LANES]{};
+        uint8_t plane_mask[LOCKSTEP_LANES]{};
+        uint8_t pitch[LOCKSTEP_LANES]{};
+        uint8_t crashed[LOCKSTEP_LANES]{};    // stopped at an unknown opcode
+        uint32_t remaining[LOCKSTEP_LANES]{}; // instructions left to run in this call to run()
+        uint8_t mask[LOCKSTEP_LANES]{};       // 0xFF for lanes executing the current instruction
+    };
+
+    unsigned int machines;
+    QuirkSet quirks;
+    std::vector<Tile> tiles;
+    std::vector<uint8_t> memory;   // MEMORY_SIZE bytes per machine
+    std::vector<Display> displays;
+    std::vector<uint8_t> keys;     // KEY_COUNT keys per machine
+    std::vector<uint8_t> flags;    // FLAG_COUNT user flags per machine
+    std::vector<uint8_t> patterns; // AUDIO_PATTERN_SIZE bytes per machine
+    std::vector<Random> rand_gen;
+
+    void run_tile(unsigned int tile, unsigned int cycles);
+    bool step(Tile &tile, unsigned int first);
+    void execute(Tile &tile, unsigned int first, const Instruction &in, uint16_t opcode);
+    void reset_flag(uint8_t *flag, const uint8_t *m) const;
+    uint16_t skip_length(unsigned int machine, uint16_t pc) const;
+};
@@ -1,18 +1,64 @@
+#include "audio.h"
 #include "chip8.h"
+#include "input_queue.h"
+#include "movie.h"
 #include "platform.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <thread>
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+    char const *record = nullptr;
+    Quirks quirks = Quirks::Legacy;
+    bool seeded = false;
+    uint64_t seed = 0;
+    bool valid = argc >= 4;
+    for (int i = 4; valid && i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+            seeded = true;
+        } else if (arg == "--record" && i + 1 < argc) {
+            record = argv[++i];
+        } else if (arg == "--quirks" && i + 1 < argc) {
+            valid = parse_quirks(argv[++i], quirks);
+        } else {
+            valid = false;
+        }
+    }
+
+    if (!valid) {
+        std::cerr << "Usage: " << argv[0] << " <Scale> <Speed> <ROM> [--seed <n>] [--record <movie>] [--quirks <name>]\n"
+                  << "  Speed is the number of instructions run per 60 Hz frame (e.g. "
+                  << DEFAULT_CYCLES_PER_FRAME << ")\n"
+                  << "  --seed seeds the random number generator, --record writes the\n"
+                  << "  session to a movie that chip8-headless --replay can play back\n"
+                  << "  --quirks picks the instruction set: legacy (default), vip, chip48,\n"
+                  << "  schip or modern\n"
+                  << "  Hold Backspace to rewind\n";
         std::exit(EXIT_FAILURE);
     }
 
     int scale = std::stoi(argv[1]);
-    int delay = std::stoi(argv[2]);
+    int cycles_per_frame = std::stoi(argv[2]);
     char const *rom = argv[3];
 
+    // A recording has to know its seed to be replayed
+    if (record != nullptr && !seeded) {
+        seed = std::chrono::system_clock::now().time_since_epoch().count();
+        seeded = true;
+    }
+
+    // the audio device plays from these until the window closes
+    AudioChannel sound;
+    AudioPlayer player(sound);
+
     Platform platform("Chip 8 Emulator", VIDEO_WIDTH * scale, VIDEO_HEIGHT * scale);
     Chip8 chip8;
 
@@ -21,19 +67,93 @@ int main(int argc, char *argv[]) {
         std::cerr << "ROM not loaded!" << std::endl;
         std::exit(EXIT_FAILURE);
     }
+    chip8.set_quirks(quirks);
+    if (seeded) {
+        chip8.seed(seed);
+    }
+
+    Movie movie;
+    movie.seed = seed;
+    movie.quirks = quirks;
+    movie.cycles_per_frame = cycles_per_frame;
+
+    // The emulator runs on its own thread so that rendering, which may wait
+    // for vsync, never slows it down. Frames go to the renderer through a
+    // triple buffer, and key presses come back through a queue. The sound
+    // for each frame goes to the audio device's thread through a channel.
+    TripleBuffer frames;
+    InputQueue input;
+    platform.open_audio(player);
+    std::atomic<bool> rewinding{false};
+    std::atomic<bool> quit{false};
+
+    std::thread emulator([&] {
+        // Emulation loop, one 60 Hz frame at a time
+        Scheduler scheduler;
+        Rewind history;
+        Snapshot snapshot;
+        uint64_t frame = 0;
+        uint8_t keypad[KEY_COUNT]{}; // held keys, apart from the machine's so rewinding can't undo them
+        while (!quit.load(std::memory_order_relaxed)) {
+            scheduler.wait_for_frame();
+            input.drain(InputQueue::now(), keypad);
 
-    // Emulation loop
-    bool quit = false;
-    while (!quit) {
-        chip8.cycle();
-        quit = platform.process_input(chip8.keypad);
-        // If draw occurred, redraw SDL screen
-        if (chip8.draw_flag) {
-            chip8.draw_flag = false;
-            platform.update(chip8.video);
+            // Step back a frame instead of running one while rewinding
+            if (rewinding.load(std::memory_order_relaxed)) {
+                if (history.pop(snapshot)) {
+                    // the frame we're back to will be played again
+                    frame--;
+                    movie.truncate(frame);
+                    chip8.restore(snapshot);
+                    chip8.dirty_rows = 0;
+                    frames.publish(chip8.display, ~0ull);
+                }
+                continue;
+            }
+
+            memcpy(chip8.keypad, keypad, sizeof(keypad));
+
+            movie.record(frame, chip8.keypad);
+            bool crashed = chip8.crashed();
+            chip8.run_frame(cycles_per_frame);
+            if (chip8.crashed() && !crashed) {
+                // the machine stops there, it can still be rewound
+                std::cerr << "Unknown opcode " << std::hex << std::uppercase << chip8.next_opcode()
+                          << " at 0x" << chip8.next_address() << std::dec << std::nouppercase << std::endl;
+            }
+            sound.push(audio_frame(chip8, frame++));
+            chip8.save(snapshot);
+            history.push(snapshot);
+
+            // If the display changed, hand the frame to the renderer
+            if (chip8.dirty_rows != 0) {
+                frames.publish(chip8.display, chip8.dirty_rows);
+                chip8.dirty_rows = 0;
+            }
+        }
+    });
+
+    // Input and render loop
+    while (!quit.load(std::memory_order_relaxed)) {
+        if (platform.process_input(input)) {
+            quit.store(true, std::memory_order_relaxed);
         }
+        rewinding.store(platform.rewinding(), std::memory_order_relaxed);
 
-        // Sleep to slow down emulation speed
-        std::this_thread::sleep_for(std::chrono::microseconds(delay * 1200));
+        // Present only when something actually changed on screen
+        uint64_t rows = frames.update() ? frames.current_rows() : 0;
+        if (!platform.update(frames.current(), rows)) {
+            // nothing new to show yet
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    emulator.join();
+
+    if (record != nullptr) {
+        movie.final_hash = chip8.hash();
+        if (!movie.write(record)) {
+            std::exit(EXIT_FAILURE);
+        }
     }
 }
@@ -0,0 +1,143 @@
+#include "movie.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+struct MovieHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t quirks;
+    uint8_t reserved;
+    uint64_t seed;
+    uint64_t frames;
+    uint64_t final_hash;
+    uint32_t cycles_per_frame;
+    uint32_t events;
+};
+
+const uint8_t PRESSED = 0x80;
+
+}
+
+void play_input(const std::vector<KeyEvent> &input, size_t &next, uint64_t frame, uint8_t keypad[]) {
+    for (; next < input.size() && input[next].frame <= frame; next++) {
+        const KeyEvent &event = input[next];
+        if (event.key < KEY_COUNT) {
+            keypad[event.key] = event.pressed ? 1 : 0;
+        }
+    }
+}
+
+void Movie::record(uint64_t frame, const uint8_t keypad[]) {
+    for (uint8_t key = 0; key < KEY_COUNT; key++) {
+        uint8_t pressed = keypad[key] ? 1 : 0;
+        if (pressed != keys[key]) {
+            keys[key] = pressed;
+            input.push_back({frame, key, pressed != 0});
+        }
+    }
+    if (frame >= frames) {
+        frames = frame + 1;
+    }
+}
+
+void Movie::truncate(uint64_t frame) {
+    while (!input.empty() && input.back().frame >= frame) {
+        input.pop_back();
+    }
+    if (frames > frame) {
+        frames = frame;
+    }
+
+    // the keypad as it was going into that frame
+    std::fill(std::begin(keys), std::end(keys), 0);
+    size_t next = 0;
+    play_input(input, next, frame, keys);
+}
+
+bool Movie::write(char const *filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    MovieHeader header{};
+    header.magic = MOVIE_MAGIC;
+    header.version = MOVIE_VERSION;
+    header.quirks = static_cast<uint8_t>(quirks);
+    header.seed = seed;
+    header.frames = frames;
+    header.final_hash = final_hash;
+    header.cycles_per_frame = cycles_per_frame;
+    header.events = static_cast<uint32_t>(input.size());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<uint8_t> data;
+    uint64_t frame = 0;
+    for (const KeyEvent &event : input) {
+        uint64_t delta = event.frame - frame;
+        frame = event.frame;
+        while (delta >= 0x80) {
+            data.push_back(static_cast<uint8_t>(delta) | 0x80);
+            delta >>= 7;
+        }
+        data.push_back(static_cast<uint8_t>(delta));
+        data.push_back(event.key | (event.pressed ? PRESSED : 0));
+    }
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return file.good();
+}
+
+bool Movie::read(char const *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    MovieHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || header.magic != MOVIE_MAGIC) {
+        std::cerr << filename << " is not a movie" << std::endl;
+        return false;
+    }
+    if (header.version != MOVIE_VERSION || header.quirks > static_cast<uint8_t>(Quirks::Modern)) {
+        std::cerr << filename << " is a movie from an incompatible version" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<KeyEvent> events;
+    events.reserve(header.events);
+    size_t at = 0;
+    uint64_t frame = 0;
+    for (uint32_t i = 0; i < header.events; i++) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while (at < data.size() && (data[at] & 0x80) && shift < 64) {
+            delta |= static_cast<uint64_t>(data[at++] & 0x7F) << shift;
+            shift += 7;
+        }
+        if (at + 2 > data.size() || shift >= 64) {
+            std::cerr << filename << " is truncated" << std::endl;
+            return false;
+        }
+        delta |= static_cast<uint64_t>(data[at++]) << shift;
+        frame += delta;
+
+        uint8_t key = data[at++];
+        events.push_back({frame, static_cast<uint8_t>(key & ~PRESSED), (key & PRESSED) != 0});
+    }
+
+    seed = header.seed;
+    quirks = static_cast<Quirks>(header.quirks);
+    frames = header.frames;
+    final_hash = header.final_hash;
+    cycles_per_frame = header.cycles_per_frame;
+    input = std::move(events);
+    std::fill(std::begin(keys), std::end(keys), 0);
+    return true;
+}
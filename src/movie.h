@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// "C8MV" in a little-endian file
+const uint32_t MOVIE_MAGIC = 0x564D3843;
+
+// Bump whenever the movie file format or what Chip8::hash() covers changes
+const uint16_t MOVIE_VERSION = 2;
+
+// A keypad change, applied at the start of the given frame
+struct KeyEvent {
+    uint64_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+// Apply the events for a frame to a keypad. next is the first event that
+// hasn't been applied yet and is advanced past the ones that were.
+void play_input(const std::vector<KeyEvent> &input, size_t &next, uint64_t frame, uint8_t keypad[]);
+
+// A recording of a run: the seed and speed it started with and every change
+// to the keypad, frame by frame. Replaying it against the same ROM from a
+// fresh machine reproduces the run bit for bit, and the state hash stored at
+// the end tells whether it did.
+//
+// On disk it's a fixed header followed by one entry per key change: the
+// number of frames since the previous change as a varint, then the key with
+// the pressed flag in the top bit. A minute of play is usually a few hundred
+// bytes.
+struct Movie {
+    uint64_t seed{};
+    uint32_t cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    Quirks quirks = Quirks::Legacy;
+    uint64_t frames{};           // length of the run
+    uint64_t final_hash{};       // Chip8::hash() at the end of the run
+    std::vector<KeyEvent> input; // sorted by frame
+
+    // Record the keypad as it is at the start of a frame, only changes are kept
+    void record(uint64_t frame, const uint8_t keypad[]);
+
+    // Forget everything from the given frame on, e.g. after rewinding
+    void truncate(uint64_t frame);
+
+    bool write(char const *filename) const;
+    bool read(char const *filename);
+
+private:
+    uint8_t keys[KEY_COUNT]{}; // the keypad as of the last recorded frame
+};
@@ -1,6 +1,8 @@
 #include "platform.h"
 #include "SDL2/SDL.h"
 #include "chip8.h"
+#include <array>
+#include <cstring>
 #include <iostream>
 
 // Keypad keymap
@@ -23,6 +25,33 @@ uint8_t keymap[16] = {
         SDLK_v,
 };
 
+// Keypad key for each key code that has one, -1 for the rest. Every mapped
+// key is a printable character, so its code is below 128.
+static const std::array<int8_t, 128> keypad_keys = [] {
+    std::array<int8_t, 128> table{};
+    table.fill(-1);
+    for (int8_t i = 0; i < 16; i++) {
+        table[keymap[i]] = i;
+    }
+    return table;
+}();
+
+// Colors for each combination of the two planes: neither, the first, the
+// second and both
+const uint32_t palette[4] = {0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555};
+
+// The bits of a byte spread out to every other bit, so two planes' bytes
+// interleave into eight 2-bit palette indexes
+static const std::array<uint16_t, 256> spread = [] {
+    std::array<uint16_t, 256> table{};
+    for (unsigned int byte = 0; byte < 256; byte++) {
+        for (unsigned int bit = 0; bit < 8; bit++) {
+            table[byte] |= ((byte >> bit) & 1u) << (2 * bit);
+        }
+    }
+    return table;
+}();
+
 Platform::Platform(char const *title, int windowWidth, int windowHeight) {
     // Initialize SDL
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
@@ -42,52 +71,139 @@ Platform::Platform(char const *title, int windowWidth, int windowHeight) {
         std::exit(EXIT_FAILURE);
     }
 
-    // Create renderer
-    renderer = SDL_CreateRenderer(window, -1, 0);
+    // Create renderer, presenting in step with the display's refresh rate
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     SDL_RenderSetLogicalSize(renderer, windowWidth, windowHeight);
 
-    // Create texture that stores frame buffer
+    // Create texture that stores frame buffer, at high resolution so both
+    // display modes fill it
     texture = SDL_CreateTexture(renderer,
                                 SDL_PIXELFORMAT_ARGB8888,
                                 SDL_TEXTUREACCESS_STREAMING,
-                                VIDEO_WIDTH, VIDEO_HEIGHT);
+                                HIRES_WIDTH, HIRES_HEIGHT);
 
 }
 
 Platform::~Platform() {
+    if (audio != 0) {
+        SDL_CloseAudioDevice(audio);
+    }
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
-void Platform::update(const uint32_t buffer[]) {
-    // Store pixels in temporary buffer
-    for (int i = 0; i < VIDEO_HEIGHT * VIDEO_WIDTH; ++i) {
-        uint8_t pixel = buffer[i];
-        pixels[i] = (0x00FFFFFF * pixel) | 0xFF000000;
+// SDL's audio callback, run on its own thread
+static void fill_audio(void *player, Uint8 *stream, int length) {
+    static_cast<AudioPlayer *>(player)->fill(reinterpret_cast<int16_t *>(stream), length / sizeof(int16_t));
+}
+
+bool Platform::open_audio(AudioPlayer &player) {
+    // a small buffer keeps the sound in step with the picture, SDL converts
+    // to whatever the device actually wants
+    SDL_AudioSpec desired{};
+    desired.freq = AUDIO_SAMPLE_RATE;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = AUDIO_BUFFER_SAMPLES;
+    desired.callback = fill_audio;
+    desired.userdata = &player;
+    audio = SDL_OpenAudioDevice(nullptr, 0, &desired, nullptr, 0);
+    if (audio == 0) {
+        std::cerr << "Couldn't open audio, SDL_Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_PauseAudioDevice(audio, 0);
+    return true;
+}
+
+// Show a frame, returns false if it's identical to the one already on screen
+bool Platform::update(const Display &display, uint64_t rows) {
+    // The rows that changed since the last present come from the core, all
+    // of them when the resolution changed
+    int height = display.height();
+    if (repaint || display.hires != shown_hires) {
+        rows = ~0ull;
+    }
+    int first = height;
+    int last = -1;
+    for (int y = 0; y < height; ++y) {
+        if ((rows >> y) & 1u) {
+            first = y < first ? y : first;
+            last = y;
+        }
+    }
+    if (last < 0 && !redraw) {
+        return false;
     }
-    SDL_UpdateTexture(texture, nullptr, pixels, 64 * sizeof(Uint32));
+
+    // Unpack only the changed rows into the pixel buffer and upload them, 8
+    // pixels of both planes at a time. At low resolution every pixel is 2x2.
+    if (last >= 0) {
+        int scale = HIRES_WIDTH / display.width();
+        int words = display.width() / 64;
+        for (int y = first; y <= last; ++y) {
+            uint32_t *line = &pixels[y * scale * HIRES_WIDTH];
+            uint32_t *pixel = line;
+            for (int word = 0; word < words; word++) {
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    uint16_t pair = spread[(display.planes[0][y][word] >> shift) & 0xFFu] |
+                                    spread[(display.planes[1][y][word] >> shift) & 0xFFu] << 1u;
+                    for (int bit = 14; bit >= 0; bit -= 2) {
+                        uint32_t color = palette[(pair >> bit) & 3u];
+                        for (int i = 0; i < scale; i++) {
+                            *pixel++ = color;
+                        }
+                    }
+                }
+            }
+            for (int i = 1; i < scale; i++) {
+                memcpy(line + i * HIRES_WIDTH, line, HIRES_WIDTH * sizeof(uint32_t));
+            }
+        }
+        shown_hires = display.hires;
+        repaint = false;
+
+        SDL_Rect changed{0, first * scale, HIRES_WIDTH, (last - first + 1) * scale};
+        SDL_UpdateTexture(texture, &changed, &pixels[first * scale * HIRES_WIDTH], HIRES_WIDTH * sizeof(Uint32));
+    }
+
+    // The renderer presents on vsync, so this is at most once per refresh
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
+    redraw = false;
+    return true;
 }
 
-bool Platform::process_input(uint8_t *keys) {
+bool Platform::process_input(InputQueue &input) {
     bool quit = false;
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
-            std::exit(EXIT_SUCCESS);
+            quit = true;
         }
 
-        for (int i = 0; i < 16; ++i) {
-            if (e.key.keysym.sym == keymap[i]) {
-                if (e.type == SDL_KEYDOWN) {
-                    keys[i] = 1;
-                } else if (e.type == SDL_KEYUP) {
-                    keys[i] = 0;
-                }
+        // the window contents may have been lost, e.g. after a resize
+        if (e.type == SDL_WINDOWEVENT) {
+            redraw = true;
+        }
+
+        if (e.key.keysym.sym == SDLK_BACKSPACE) {
+            if (e.type == SDL_KEYDOWN) {
+                rewind = true;
+            } else if (e.type == SDL_KEYUP) {
+                rewind = false;
+            }
+        }
+
+        // held keys repeat, but only the first press changes anything
+        bool key = e.type == SDL_KEYUP || (e.type == SDL_KEYDOWN && !e.key.repeat);
+        if (key && e.key.keysym.sym >= 0 && e.key.keysym.sym < 128) {
+            int8_t pressed = keypad_keys[e.key.keysym.sym];
+            if (pressed >= 0) {
+                input.push({InputQueue::now(), static_cast<uint8_t>(pressed), e.type == SDL_KEYDOWN});
             }
         }
     }
@@ -2,18 +2,27 @@
 
 #include <cstdint>
 #include <SDL2/SDL.h>
+#include "audio.h"
 #include "chip8.h"
+#include "input_queue.h"
 
 class Platform
 {
 public:
     Platform(char const* title, int windowWidth, int windowHeight);
     ~Platform();
-    void update(const uint32_t buffer[]);
-    bool process_input(uint8_t* keys);
+    bool update(const Display &display, uint64_t rows); // rows has bit y set for each row changed since the last call
+    bool process_input(InputQueue& input); // queues keypad changes, true when quitting
+    bool rewinding() const { return rewind; }
+    bool open_audio(AudioPlayer& player); // plays until the window closes, false without a sound device
 private:
-    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+    uint32_t pixels[HIRES_WIDTH * HIRES_HEIGHT]{};
+    bool shown_hires = false;       // resolution of what's on screen right now
+    bool repaint = true;            // every row has to be unpacked again
+    bool redraw = true;             // the window needs presenting even if nothing changed
+    bool rewind = false;            // the rewind key is held down
     SDL_Texture* texture{};
     SDL_Renderer* renderer{};
     SDL_Window* window{};
+    SDL_AudioDeviceID audio{};
 };
\ No newline at end of file
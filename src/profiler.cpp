@@ -0,0 +1,132 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+std::string hex(unsigned int value) {
+    char text[8];
+    snprintf(text, sizeof(text), "0x%03X", value);
+    return text;
+}
+
+std::string percent(uint64_t part, uint64_t total) {
+    char text[16];
+    snprintf(text, sizeof(text), "%5.1f%%", total ? 100.0 * part / total : 0.0);
+    return text;
+}
+
+}
+
+// Work out the call chain from the return addresses on the stack: each one
+// sits right after the 2nnn that made the call, and nnn is the subroutine
+void Profiler::enter(const uint16_t *stack, uint8_t sp, const uint8_t *memory) {
+    calls.clear();
+    for (uint8_t level = 0; level < sp && level < STACK_LEVELS; level++) {
+        uint16_t site = (stack[level] - 2) & (MEMORY_SIZE - 1);
+        uint16_t opcode = memory[site] << 8u | memory[(site + 1) & (MEMORY_SIZE - 1)];
+        calls.push_back(opcode & 0x0FFFu);
+    }
+    chain = &chains[calls];
+}
+
+void Profiler::report(std::ostream &out, unsigned int top) const {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+    for (const Counter &op : ops) {
+        count += op.count;
+        ticks += op.ticks;
+    }
+    out << count << " instructions, " << ticks << " ticks\n";
+
+    // handlers by time spent in them
+    std::vector<unsigned int> order;
+    for (unsigned int op = 0; op < OP_COUNT; op++) {
+        if (ops[op].count) {
+            order.push_back(op);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+        return ops[a].ticks > ops[b].ticks;
+    });
+    out << "\nHandlers          count    time  ticks/instruction\n";
+    for (unsigned int op : order) {
+        char line[96];
+        snprintf(line, sizeof(line), "  %-6s %14llu  %s  %8.1f\n", op_names[op],
+                 static_cast<unsigned long long>(ops[op].count), percent(ops[op].ticks, ticks).c_str(),
+                 static_cast<double>(ops[op].ticks) / ops[op].count);
+        out << line;
+    }
+
+    // addresses by time spent at them
+    order.clear();
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        if (addresses[address].count) {
+            order.push_back(address);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+        return addresses[a].ticks > addresses[b].ticks;
+    });
+    out << "\nAddresses         count    time\n";
+    for (size_t i = 0; i < order.size() && i < top; i++) {
+        unsigned int address = order[i];
+        char line[96];
+        snprintf(line, sizeof(line), "  %s %14llu  %s\n", hex(address).c_str(),
+                 static_cast<unsigned long long>(addresses[address].count),
+                 percent(addresses[address].ticks, ticks).c_str());
+        out << line;
+    }
+
+    // loops by the time spent inside their bodies
+    struct Loop {
+        uint16_t start, end;
+        uint64_t iterations, count, ticks;
+    };
+    std::vector<Loop> hot;
+    for (const auto &loop : loops) {
+        Loop entry{loop.first.first, loop.first.second, loop.second, 0, 0};
+        for (unsigned int address = entry.start; address <= entry.end; address++) {
+            entry.count += addresses[address].count;
+            entry.ticks += addresses[address].ticks;
+        }
+        hot.push_back(entry);
+    }
+    std::sort(hot.begin(), hot.end(), [](const Loop &a, const Loop &b) {
+        return a.ticks > b.ticks;
+    });
+    out << "\nLoops                 iterations    time  instructions/iteration\n";
+    for (size_t i = 0; i < hot.size() && i < top; i++) {
+        const Loop &loop = hot[i];
+        char line[128];
+        snprintf(line, sizeof(line), "  %s-%s %18llu  %s  %8.1f\n", hex(loop.start).c_str(),
+                 hex(loop.end).c_str(), static_cast<unsigned long long>(loop.iterations),
+                 percent(loop.ticks, ticks).c_str(),
+                 static_cast<double>(loop.count) / loop.iterations);
+        out << line;
+    }
+    out.flush();
+}
+
+void Profiler::write_folded(std::ostream &out) const {
+    for (const auto &chain : chains) {
+        if (chain.second.count == 0) {
+            continue;
+        }
+        out << "main";
+        for (uint16_t address : chain.first) {
+            out << ";" << hex(address);
+        }
+        out << " " << chain.second.count << "\n";
+    }
+    out.flush();
+}
+
+void Profiler::clear() {
+    std::fill(std::begin(ops), std::end(ops), Counter{});
+    std::fill(std::begin(addresses), std::end(addresses), Counter{});
+    loops.clear();
+    chains.clear();
+    chain = nullptr;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "chip8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Host time stamp used to weigh instructions: the TSC where there is one,
+// nanoseconds otherwise
+inline uint64_t profiler_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Counts what a machine executes: per handler, per ROM address, per loop
+// and per call chain. Attach one to Chip8::profiler in a build configured
+// with -DCHIP8_PROFILE=ON; without it the hooks aren't compiled in at all.
+//
+// While a profiler is attached every core runs through Chip8::cycle(), so
+// the numbers describe the ROM rather than the engine running it.
+class Profiler {
+public:
+    struct Counter {
+        uint64_t count;
+        uint64_t ticks;
+    };
+
+    Counter ops[OP_COUNT]{};
+    std::vector<Counter> addresses = std::vector<Counter>(MEMORY_SIZE);
+
+    // Called by Chip8::cycle() after each instruction with where it was,
+    // what it was, how long it took and the machine's state after it
+    void record(uint16_t address, uint8_t op, uint64_t ticks, uint16_t pc,
+                const uint16_t *stack, uint8_t sp, const uint8_t *memory) {
+        ops[op].count++;
+        ops[op].ticks += ticks;
+        addresses[address].count++;
+        addresses[address].ticks += ticks;
+
+        if (op == OP_2nnn || op == OP_00EE || chain == nullptr) {
+            enter(stack, sp, memory);
+        } else if (pc <= address) {
+            // a jump backwards closes a loop
+            loops[{pc, address}]++;
+        }
+        chain->count++;
+        chain->ticks += ticks;
+    }
+
+    // Handlers, addresses and loops that took the most time
+    void report(std::ostream &out, unsigned int top = 10) const;
+
+    // One line per call chain in the folded format read by flamegraph.pl,
+    // weighted by instructions executed
+    void write_folded(std::ostream &out) const;
+
+    void clear();
+
+private:
+    std::map<std::pair<uint16_t, uint16_t>, uint64_t> loops; // (start, end) -> iterations
+    std::map<std::vector<uint16_t>, Counter> chains;         // subroutine addresses -> counts
+    Counter *chain{};                                        // the chain executing right now
+    std::vector<uint16_t> calls;
+
+    void enter(const uint16_t *stack, uint8_t sp, const uint8_t *memory);
+};
@@ -0,0 +1,143 @@
+#include "rewind.h"
+#include <cstring>
+
+// Runs of unchanged bytes shorter than this are cheaper to store as literals
+const size_t MIN_ZERO_RUN = 4;
+
+namespace {
+
+void put_varint(std::vector<uint8_t> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+size_t get_varint(const uint8_t *&in) {
+    size_t value = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        value |= static_cast<size_t>(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return value | static_cast<size_t>(*in++) << shift;
+}
+
+// Encode a XOR b as a sequence of (unchanged run, literal count, literals)
+void encode_delta(const uint8_t *a, const uint8_t *b, size_t size, std::vector<uint8_t> &out) {
+    out.clear();
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && a[i + zeros] == b[i + zeros]) {
+            zeros++;
+        }
+        i += zeros;
+
+        // literals run until the next stretch of unchanged bytes worth skipping
+        size_t literals = 0;
+        size_t same = 0;
+        while (i + literals + same < size && same < MIN_ZERO_RUN) {
+            if (a[i + literals + same] == b[i + literals + same]) {
+                same++;
+            } else {
+                literals += same + 1;
+                same = 0;
+            }
+        }
+
+        put_varint(out, zeros);
+        put_varint(out, literals);
+        for (size_t j = 0; j < literals; j++) {
+            out.push_back(a[i + j] ^ b[i + j]);
+        }
+        i += literals;
+    }
+}
+
+// XOR an encoded delta back into a state
+void apply_delta(const uint8_t *in, size_t length, uint8_t *state) {
+    const uint8_t *end = in + length;
+    while (in < end) {
+        state += get_varint(in);
+        size_t literals = get_varint(in);
+        for (size_t j = 0; j < literals; j++) {
+            *state++ ^= *in++;
+        }
+    }
+}
+
+}
+
+Rewind::Rewind(size_t capacity) : ring(capacity) {
+}
+
+void Rewind::push(const Snapshot &snapshot) {
+    if (started) {
+        encode_delta(reinterpret_cast<const uint8_t *>(&current),
+                     reinterpret_cast<const uint8_t *>(&snapshot), sizeof(Snapshot), scratch);
+        store(scratch.data(), scratch.size());
+    }
+    current = snapshot;
+    started = true;
+}
+
+bool Rewind::pop(Snapshot &snapshot) {
+    if (entries.empty()) {
+        return false;
+    }
+
+    // the newest entry turns the current state into the one before it
+    Entry entry = entries.back();
+    entries.pop_back();
+    apply_delta(&ring[entry.offset], entry.length, reinterpret_cast<uint8_t *>(&current));
+    head = entry.offset;
+
+    snapshot = current;
+    return true;
+}
+
+size_t Rewind::frames() const {
+    return entries.size();
+}
+
+size_t Rewind::used() const {
+    size_t total = 0;
+    for (const Entry &entry : entries) {
+        total += entry.length;
+    }
+    return total;
+}
+
+void Rewind::clear() {
+    entries.clear();
+    head = 0;
+    started = false;
+}
+
+// Append an encoded delta to the ring, dropping the oldest ones in its way
+void Rewind::store(const uint8_t *data, size_t length) {
+    if (length > ring.size()) {
+        // can't step back past this frame
+        entries.clear();
+        head = 0;
+        return;
+    }
+
+    if (head + length > ring.size()) {
+        // everything between here and the end is older than anything at the start
+        while (!entries.empty() && entries.front().offset >= head) {
+            entries.pop_front();
+        }
+        head = 0;
+    }
+    while (!entries.empty() && entries.front().offset < head + length &&
+           entries.front().offset + entries.front().length > head) {
+        entries.pop_front();
+    }
+
+    memcpy(&ring[head], data, length);
+    entries.push_back({head, length});
+    head += length;
+}
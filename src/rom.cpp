@@ -0,0 +1,128 @@
+#include "rom.h"
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool check_size(size_t size) {
+    if (size > MAX_ROM_SIZE) {
+        std::cerr << "ROM is too large (" << size << " bytes, at most " << MAX_ROM_SIZE << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const Rom> Rom::map(char const *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return nullptr;
+    }
+
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        std::cerr << filename << " is not a file" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    if (size == 0) {
+        std::cerr << filename << " is empty" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    if (!check_size(size)) {
+        close(fd);
+        return nullptr;
+    }
+
+    // the mapping keeps the file open by itself
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Couldn't map file " << filename << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<Rom> rom(new Rom());
+    rom->mapping = mapping;
+    rom->bytes = static_cast<const uint8_t *>(mapping);
+    rom->length = size;
+    rom->content_hash = hash_bytes(HASH_SEED, rom->bytes, size);
+    return rom;
+}
+
+std::shared_ptr<const Rom> Rom::copy(const uint8_t *data, size_t size) {
+    if (!check_size(size)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Rom> rom(new Rom());
+    rom->owned.assign(data, data + size);
+    rom->bytes = rom->owned.data();
+    rom->length = size;
+    rom->content_hash = hash_bytes(HASH_SEED, data, size);
+    return rom;
+}
+
+Rom::~Rom() {
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+    }
+}
+
+namespace {
+
+std::mutex cache_mutex;
+std::unordered_multimap<uint64_t, std::shared_ptr<const Rom>> cache;
+
+// A cached image with the same contents, compared in full in case two ROMs
+// hash the same
+std::shared_ptr<const Rom> find(uint64_t hash, const uint8_t *data, size_t size) {
+    auto range = cache.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Rom &rom = *it->second;
+        if (rom.size() == size && memcmp(rom.data(), data, size) == 0) {
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+std::shared_ptr<const Rom> RomCache::load(char const *filename) {
+    std::shared_ptr<const Rom> rom = Rom::map(filename);
+    return rom ? insert(rom) : nullptr;
+}
+
+std::shared_ptr<const Rom> RomCache::intern(const uint8_t *data, size_t size) {
+    uint64_t hash = hash_bytes(HASH_SEED, data, size);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (auto found = find(hash, data, size)) {
+            return found;
+        }
+    }
+
+    std::shared_ptr<const Rom> rom = Rom::copy(data, size);
+    return rom ? insert(rom) : nullptr;
+}
+
+size_t RomCache::size() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache.size();
+}
+
+std::shared_ptr<const Rom> RomCache::insert(std::shared_ptr<const Rom> rom) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (auto found = find(rom->hash(), rom->data(), rom->size())) {
+        return found;
+    }
+    cache.emplace(rom->hash(), rom);
+    return rom;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "chip8.h"
+
+// A read-only ROM image. One from a file is mapped rather than read, so
+// it's never copied until it's loaded into a machine's memory. Either way
+// its size has been checked against MAX_ROM_SIZE.
+class Rom {
+public:
+    // Map a ROM file, nullptr if it can't be opened or is empty or too large
+    static std::shared_ptr<const Rom> map(char const *filename);
+
+    // Copy a ROM that's already in memory, nullptr if it's too large
+    static std::shared_ptr<const Rom> copy(const uint8_t *data, size_t size);
+
+    ~Rom();
+    Rom(const Rom &) = delete;
+    Rom &operator=(const Rom &) = delete;
+
+    const uint8_t *data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    // FNV-1a of the contents
+    uint64_t hash() const {
+        return content_hash;
+    }
+
+private:
+    Rom() = default;
+
+    const uint8_t *bytes{};
+    size_t length{};
+    uint64_t content_hash{};
+    void *mapping{};            // munmap'd on destruction, null for a copy
+    std::vector<uint8_t> owned; // the bytes of a copy
+};
+
+// Every ROM the process has loaded, kept by content. Loading the same ROM
+// again, or another file with the same contents, gives back the first
+// image, so batch runs share one read-only copy of each ROM however many
+// machines they start from it. Images stay cached until the process exits,
+// they're at most 64K each. Safe to use from any thread.
+class RomCache {
+public:
+    // The cached image of a ROM file's contents. The file is mapped to hash
+    // it, and the mapping is dropped again if the contents are known.
+    static std::shared_ptr<const Rom> load(char const *filename);
+
+    // The cached image with these contents, copying them if it's new
+    static std::shared_ptr<const Rom> intern(const uint8_t *data, size_t size);
+
+    // Number of distinct ROMs cached
+    static size_t size();
+
+private:
+    static std::shared_ptr<const Rom> insert(std::shared_ptr<const Rom> rom);
+};
@@ -0,0 +1,28 @@
+#include "scheduler.h"
+#include <thread>
+
+Scheduler::Scheduler(bool throttled, unsigned int frames_per_second)
+        : throttled(throttled),
+          frame_time(std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) / frames_per_second) {
+}
+
+void Scheduler::wait_for_frame() {
+    count++;
+    if (!throttled) {
+        return;
+    }
+
+    clock::time_point now = clock::now();
+    if (count == 1 || now > next + MAX_FRAME_LAG * frame_time) {
+        // first frame, or we've fallen too far behind (e.g. the window was
+        // being dragged), so start counting from now instead of rushing
+        next = now;
+    }
+
+    std::this_thread::sleep_until(next);
+    next += frame_time;
+}
+
+uint64_t Scheduler::frames() const {
+    return count;
+}
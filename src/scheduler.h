@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "chip8.h"
+
+// Frames the scheduler may fall behind before it gives up catching up
+const unsigned int MAX_FRAME_LAG = 5;
+
+// Paces emulation in 60 Hz frames against a monotonic clock. Each frame is
+// due at a fixed point in time, so the speed never depends on how long the
+// host actually sleeps. An unthrottled scheduler never waits, for batch and
+// headless runs.
+class Scheduler {
+public:
+    explicit Scheduler(bool throttled = true, unsigned int frames_per_second = FRAMES_PER_SECOND);
+
+    // Wait until the next frame is due
+    void wait_for_frame();
+
+    uint64_t frames() const;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    bool throttled;
+    clock::duration frame_time;
+    clock::time_point next;
+    uint64_t count{};
+};
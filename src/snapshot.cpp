@@ -0,0 +1,37 @@
+#include "snapshot.h"
+#include <fstream>
+#include <iostream>
+
+bool Snapshot::write(char const *filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(this), sizeof(Snapshot));
+    return file.good();
+}
+
+bool Snapshot::read(char const *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    Snapshot snapshot;
+    file.read(reinterpret_cast<char *>(&snapshot), sizeof(Snapshot));
+    if (!file || snapshot.magic != SNAPSHOT_MAGIC) {
+        std::cerr << filename << " is not a snapshot" << std::endl;
+        return false;
+    }
+    if (snapshot.version != SNAPSHOT_VERSION || snapshot.size != sizeof(Snapshot)
+        || snapshot.quirks > Quirks::Modern) {
+        std::cerr << filename << " is a snapshot from an incompatible version" << std::endl;
+        return false;
+    }
+
+    *this = snapshot;
+    return true;
+}
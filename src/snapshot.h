@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include "chip8.h"
+
+// "C8SS" in a little-endian file
+const uint32_t SNAPSHOT_MAGIC = 0x53533843;
+
+// Bump whenever the layout of Snapshot changes
+const uint16_t SNAPSHOT_VERSION = 5;
+
+// Everything needed to put a machine back exactly where it was. It's a
+// plain struct, so copying one around is a single memcpy, and the file
+// format is just its bytes in host byte order behind a versioned header.
+// Almost all of its 66 KB is XO-CHIP's 64K of memory, which every snapshot
+// holds in full even when the ROM only ever touches the first 4K.
+struct Snapshot {
+    uint32_t magic = SNAPSHOT_MAGIC;
+    uint16_t version = SNAPSHOT_VERSION;
+    Quirks quirks = Quirks::Legacy; // the profile it was saved under, restored with it
+    uint8_t reserved{};
+    uint32_t size = sizeof(Snapshot); // catches snapshots from builds with a different layout
+
+    uint8_t memory[MEMORY_SIZE]{};
+    Display display;
+    uint16_t stack[STACK_LEVELS]{};
+    uint8_t registers[REGISTER_COUNT]{};
+    uint8_t keypad[KEY_COUNT]{};
+    uint16_t index{};
+    uint16_t pc{};
+    uint8_t sp{};
+    uint8_t delay_timer{};
+    uint8_t sound_timer{};
+    uint8_t plane_mask{};
+    uint8_t pitch{};
+    uint8_t crashed{}; // stopped at an unknown opcode
+    uint8_t user_flags[FLAG_COUNT]{};
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE]{};
+    Random rand_gen;
+
+    bool write(char const *filename) const;
+    bool read(char const *filename);
+};
@@ -0,0 +1,76 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static_assert(sizeof(TraceRecord) == 8, "trace records are written as they are");
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "the ring is indexed with a mask");
+
+Tracer::Tracer() : ring(TRACE_RING_SIZE) {
+}
+
+Tracer::~Tracer() {
+    close();
+}
+
+bool Tracer::open(char const *filename) {
+    close();
+
+    file = std::fopen(filename, "wb");
+    if (file == nullptr) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    TraceHeader header{TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord)};
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    stop.store(false, std::memory_order_relaxed);
+    writer = std::thread(&Tracer::drain, this);
+    return true;
+}
+
+void Tracer::close() {
+    if (writer.joinable()) {
+        stop.store(true, std::memory_order_release);
+        writer.join();
+    }
+    if (file != nullptr) {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+uint64_t Tracer::records() const {
+    return head.load(std::memory_order_relaxed);
+}
+
+// Background thread: copy whatever the machine has recorded into the file
+void Tracer::drain() {
+    while (true) {
+        // read stop first, so that everything recorded before close() is seen
+        bool stopping = stop.load(std::memory_order_acquire);
+        size_t end = head.load(std::memory_order_acquire);
+        size_t start = tail.load(std::memory_order_relaxed);
+
+        if (start == end) {
+            if (stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // the filled part of the ring may wrap around its end
+        while (start != end) {
+            size_t offset = start & (TRACE_RING_SIZE - 1);
+            size_t count = std::min(end - start, TRACE_RING_SIZE - offset);
+            std::fwrite(&ring[offset], sizeof(TraceRecord), count, file);
+            start += count;
+        }
+        tail.store(end, std::memory_order_release);
+    }
+    std::fflush(file);
+}
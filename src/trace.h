@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// "C8TR" in a little-endian file
+const uint32_t TRACE_MAGIC = 0x52543843;
+
+// Bump whenever the layout of TraceRecord changes
+const uint16_t TRACE_VERSION = 1;
+
+// Records buffered between the machine and the file, a power of two
+const size_t TRACE_RING_SIZE = 64 * 1024;
+
+// One executed instruction, with the register it writes and the index as
+// they were afterwards. Fx65 also loads the registers below Vx, and 8xy4-8xyE
+// set VF, which is kept too.
+struct TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t index;
+    uint8_t vx; // register x of the opcode when it writes it (see writes_vx), 0 otherwise
+    uint8_t vf;
+};
+
+struct TraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+};
+
+// Writes every instruction a machine executes to a file. The machine puts
+// records into a ring buffer that only it writes to and a background thread
+// drains into the file, with no locks in between; when the writer falls a
+// whole ring behind, the machine waits for it so nothing is lost. Attach one
+// to each traced Chip8 (Chip8::tracer), so each emulation thread has its own.
+//
+// The file is a TraceHeader followed by the records in order, see
+// chip8-trace for reading one.
+class Tracer {
+public:
+    Tracer();
+    ~Tracer();
+
+    bool open(char const *filename);
+
+    // Write out everything recorded so far and close the file
+    void close();
+
+    void record(const TraceRecord &record) {
+        size_t position = head.load(std::memory_order_relaxed);
+        while (position - tail.load(std::memory_order_acquire) == TRACE_RING_SIZE) {
+            std::this_thread::yield();
+        }
+        ring[position & (TRACE_RING_SIZE - 1)] = record;
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    uint64_t records() const;
+
+private:
+    std::vector<TraceRecord> ring;
+    alignas(64) std::atomic<size_t> head{0}; // next record to fill, owned by the machine
+    alignas(64) std::atomic<size_t> tail{0}; // next record to write, owned by the writer
+    std::atomic<bool> stop{false};
+    std::FILE *file{};
+    std::thread writer;
+
+    void drain();
+};
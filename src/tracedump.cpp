@@ -0,0 +1,140 @@
+#include "chip8.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage(char const *program) {
+    std::cerr << "Usage: " << program << " [options] <trace>\n"
+              << "  --from <n>      start at record n\n"
+              << "  --count <n>     print at most n records\n"
+              << "  --tail <n>      print the last n records, e.g. the ones before a crash\n"
+              << "  --stats         print how often each instruction and address ran instead\n";
+    std::exit(EXIT_FAILURE);
+}
+
+static bool read_trace(char const *filename, std::vector<TraceRecord> &records) {
+    std::FILE *file = std::fopen(filename, "rb");
+    if (file == nullptr) {
+        std::cerr << "Couldn't open file " << filename << std::endl;
+        return false;
+    }
+
+    TraceHeader header{};
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC) {
+        std::cerr << filename << " is not a trace" << std::endl;
+        std::fclose(file);
+        return false;
+    }
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        std::cerr << filename << " is a trace from an incompatible version" << std::endl;
+        std::fclose(file);
+        return false;
+    }
+
+    TraceRecord chunk[4096];
+    size_t count;
+    while ((count = std::fread(chunk, sizeof(TraceRecord), 4096, file)) > 0) {
+        records.insert(records.end(), chunk, chunk + count);
+    }
+    std::fclose(file);
+    return true;
+}
+
+static void print_record(uint64_t number, const TraceRecord &record) {
+    const Instruction &in = decode_table[record.opcode];
+    printf("%10llu  %03X  %04X  %-18s ", static_cast<unsigned long long>(number), record.pc,
+           record.opcode, disassemble(record.opcode).c_str());
+    // only instructions that write Vx have one worth showing, VF always is
+    if (writes_vx(in.op) && in.x != 0xF) {
+        printf("V%X=%02X ", in.x, record.vx);
+    }
+    printf("VF=%02X I=%03X\n", record.vf, record.index);
+}
+
+static void print_stats(const std::vector<TraceRecord> &records) {
+    std::vector<uint64_t> ops(OP_COUNT);
+    std::vector<uint64_t> addresses(MEMORY_SIZE);
+    for (const TraceRecord &record : records) {
+        ops[decode_table[record.opcode].op]++;
+        addresses[record.pc & (MEMORY_SIZE - 1)]++;
+    }
+
+    printf("%zu instructions\n\nHandlers\n", records.size());
+    std::vector<unsigned int> order;
+    for (unsigned int op = 0; op < OP_COUNT; op++) {
+        if (ops[op]) {
+            order.push_back(op);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&ops](unsigned int a, unsigned int b) { return ops[a] > ops[b]; });
+    for (unsigned int op : order) {
+        printf("  %-6s %14llu  %5.1f%%\n", op_names[op], static_cast<unsigned long long>(ops[op]),
+               100.0 * ops[op] / records.size());
+    }
+
+    printf("\nAddresses\n");
+    order.clear();
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        if (addresses[address]) {
+            order.push_back(address);
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [&addresses](unsigned int a, unsigned int b) { return addresses[a] > addresses[b]; });
+    for (size_t i = 0; i < order.size() && i < 20; i++) {
+        printf("  %03X  %14llu  %5.1f%%\n", order[i], static_cast<unsigned long long>(addresses[order[i]]),
+               100.0 * addresses[order[i]] / records.size());
+    }
+}
+
+// Print a trace written by chip8-headless --trace as assembly
+int main(int argc, char *argv[]) {
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    uint64_t tail = 0;
+    bool stats = false;
+    char const *filename = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--from" && has_value) {
+            from = std::stoull(argv[++i]);
+        } else if (arg == "--count" && has_value) {
+            count = std::stoull(argv[++i]);
+        } else if (arg == "--tail" && has_value) {
+            tail = std::stoull(argv[++i]);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (filename == nullptr && arg[0] != '-') {
+            filename = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (filename == nullptr) {
+        usage(argv[0]);
+    }
+
+    std::vector<TraceRecord> records;
+    if (!read_trace(filename, records)) {
+        return EXIT_FAILURE;
+    }
+
+    if (stats) {
+        print_stats(records);
+        return 0;
+    }
+
+    if (tail > 0 && tail < records.size()) {
+        from = records.size() - tail;
+    }
+    for (uint64_t i = from; i < records.size() && i - from < count; i++) {
+        print_record(i, records[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "triple_buffer.h"
+
+void TripleBuffer::publish(const Display &display, uint64_t changed) {
+    frames[back] = display;
+    pending |= changed;
+    rows[back] = pending;
+    uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = previous & INDEX;
+
+    // once the last frame has been picked up, the renderer is at most one
+    // frame behind; otherwise that frame's rows are still owed
+    if ((previous & FRESH) == 0) {
+        pending = changed;
+    }
+}
+
+bool TripleBuffer::update() {
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+        return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    return true;
+}
+
+const Display &TripleBuffer::current() const {
+    return frames[front];
+}
+
+uint64_t TripleBuffer::current_rows() const {
+    return rows[front];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "chip8.h"
+
+// Hands completed frames from the emulator thread to the render thread
+// without locks. The emulator always has a buffer of its own to publish
+// into, so it never waits for the renderer, and the renderer always picks
+// up the most recent frame, skipping any it was too slow to show. Each
+// frame carries the rows that changed since the one the renderer had, so
+// the rows of skipped frames aren't lost.
+class TripleBuffer {
+public:
+    // Emulator side: copy a finished frame in and make it the latest, rows
+    // has bit y set for each row that changed since the last one published
+    void publish(const Display &display, uint64_t rows);
+
+    // Render side: if a new frame was published since the last call, make it
+    // the current one and return true
+    bool update();
+
+    // Render side: the frame picked up by the last successful update()
+    const Display &current() const;
+
+    // Render side: the rows of the current frame that changed since the
+    // frame before it
+    uint64_t current_rows() const;
+
+private:
+    // Set in `middle` when the frame in it hasn't been picked up yet
+    static const uint8_t FRESH = 0x4;
+    static const uint8_t INDEX = 0x3;
+
+    Display frames[3];
+    uint64_t rows[3]{};
+    uint64_t pending = 0;             // rows changed since the frame the renderer has, owned by the emulator
+    uint8_t back = 0;                 // owned by the emulator
+    uint8_t front = 1;                // owned by the renderer
+    std::atomic<uint8_t> middle{2};   // swapped between the two
+};